@@ -29,4 +29,9 @@ namespace dgn
 
         return pos * rot;
     }
+
+    Frustum Camera::getFrustum() const
+    {
+        return Frustum::fromMatrix(getProjection() * getView());
+    }
 }
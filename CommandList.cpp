@@ -0,0 +1,533 @@
+#include "DragonEngine/CommandList.h"
+#include "d_internal.h"
+
+#include <m3d/vec2.h>
+#include <m3d/vec3.h>
+#include <m3d/vec4.h>
+#include <m3d/mat3x3.h>
+#include <m3d/mat4x4.h>
+
+#include <stddef.h>
+#include <string.h>
+
+namespace dgn
+{
+    enum CommandType
+    {
+        COMMAND_CLEAR = 0,
+        COMMAND_BEGIN_REGION,
+        COMMAND_END_REGION,
+        COMMAND_BIND_MESH,
+        COMMAND_BIND_SHADER,
+        COMMAND_BIND_TEXTURE,
+        COMMAND_BIND_FRAMEBUFFER,
+        COMMAND_UNBIND_FRAMEBUFFER,
+        COMMAND_DRAW,
+        COMMAND_DRAW_RANGE,
+        COMMAND_DRAW_INSTANCED,
+        COMMAND_DRAW_INDIRECT,
+        COMMAND_DEPTH_TEST,
+        COMMAND_VIEWPORT,
+        COMMAND_CULL_FACE,
+        COMMAND_CLIP_MODE,
+        COMMAND_ENABLE_FLAG,
+        COMMAND_DISABLE_FLAG,
+        COMMAND_UNIFORM_FLOAT,
+        COMMAND_UNIFORM_INT,
+        COMMAND_UNIFORM_VEC2,
+        COMMAND_UNIFORM_VEC3,
+        COMMAND_UNIFORM_VEC4,
+        COMMAND_UNIFORM_MAT3,
+        COMMAND_UNIFORM_MAT4,
+        // same order as the location uniforms above
+        COMMAND_SHADER_UNIFORM_FLOAT,
+        COMMAND_SHADER_UNIFORM_INT,
+        COMMAND_SHADER_UNIFORM_VEC2,
+        COMMAND_SHADER_UNIFORM_VEC3,
+        COMMAND_SHADER_UNIFORM_VEC4,
+        COMMAND_SHADER_UNIFORM_MAT3,
+        COMMAND_SHADER_UNIFORM_MAT4
+    };
+
+    // every command is a header followed by size bytes of payload, read back with memcpy so nothing needs aligning
+    struct CommandHeader
+    {
+        uint16_t type;
+        uint16_t size;
+    };
+
+    // textures and framebuffers are small handles, copied so getters returning them by value can be recorded
+    struct TextureCommand
+    {
+        Texture texture;
+        unsigned slot;
+    };
+
+    struct IndirectCommand
+    {
+        const DrawIndirectBuffer *buffer;
+        unsigned binding;
+    };
+
+    // uniform location followed by up to 16 floats or one int
+    struct UniformCommand
+    {
+        int loc;
+        float values[16];
+    };
+
+    // shader and uniform handle followed by up to 16 floats or one int
+    struct ShaderUniformCommand
+    {
+        Shader *shader;
+        uint32_t hash;
+        unsigned index;
+        float values[16];
+    };
+
+    CommandList::CommandList() : m_count(0) {}
+
+    void CommandList::pushInternal(unsigned type, const void* payload, unsigned size)
+    {
+        CommandHeader header = {uint16_t(type), uint16_t(size)};
+
+        size_t offset = m_data.size();
+        m_data.resize(offset + sizeof(header) + size);
+
+        memcpy(&m_data[offset], &header, sizeof(header));
+        if(size) memcpy(&m_data[offset + sizeof(header)], payload, size);
+
+        m_count++;
+    }
+
+    void CommandList::reset()
+    {
+        m_data.clear();
+        m_count = 0;
+    }
+
+    void CommandList::clear()
+    {
+        pushInternal(COMMAND_CLEAR, nullptr, 0);
+    }
+
+    void CommandList::beginRegion(const char* name)
+    {
+        pushInternal(COMMAND_BEGIN_REGION, &name, sizeof(name));
+    }
+
+    void CommandList::endRegion()
+    {
+        pushInternal(COMMAND_END_REGION, nullptr, 0);
+    }
+
+    void CommandList::bindMesh(const Mesh& mesh)
+    {
+        const Mesh *p = &mesh;
+        pushInternal(COMMAND_BIND_MESH, &p, sizeof(p));
+    }
+
+    void CommandList::bindShader(const Shader& shader)
+    {
+        const Shader *p = &shader;
+        pushInternal(COMMAND_BIND_SHADER, &p, sizeof(p));
+    }
+
+    void CommandList::bindTexture(const Texture& texture, unsigned slot)
+    {
+        TextureCommand c = {texture, slot};
+        pushInternal(COMMAND_BIND_TEXTURE, &c, sizeof(c));
+    }
+
+    void CommandList::bindFramebuffer(const Framebuffer& framebuffer)
+    {
+        pushInternal(COMMAND_BIND_FRAMEBUFFER, &framebuffer, sizeof(framebuffer));
+    }
+
+    void CommandList::unbindFramebuffer()
+    {
+        pushInternal(COMMAND_UNBIND_FRAMEBUFFER, nullptr, 0);
+    }
+
+    void CommandList::drawBoundMesh()
+    {
+        pushInternal(COMMAND_DRAW, nullptr, 0);
+    }
+
+    void CommandList::drawBoundMeshRange(unsigned first_index, unsigned count)
+    {
+        unsigned c[2] = {first_index, count};
+        pushInternal(COMMAND_DRAW_RANGE, c, sizeof(c));
+    }
+
+    void CommandList::drawBoundMeshInstanced(unsigned count, unsigned base_instance)
+    {
+        unsigned c[2] = {count, base_instance};
+        pushInternal(COMMAND_DRAW_INSTANCED, c, sizeof(c));
+    }
+
+    void CommandList::drawIndirect(const DrawIndirectBuffer& buffer, unsigned draw_data_binding)
+    {
+        IndirectCommand c = {&buffer, draw_data_binding};
+        pushInternal(COMMAND_DRAW_INDIRECT, &c, sizeof(c));
+    }
+
+    void CommandList::setDepthTest(DepthTest func)
+    {
+        pushInternal(COMMAND_DEPTH_TEST, &func, sizeof(func));
+    }
+
+    void CommandList::setViewport(unsigned x, unsigned y, unsigned width, unsigned height)
+    {
+        unsigned c[4] = {x, y, width, height};
+        pushInternal(COMMAND_VIEWPORT, c, sizeof(c));
+    }
+
+    void CommandList::setCullFace(Face face)
+    {
+        pushInternal(COMMAND_CULL_FACE, &face, sizeof(face));
+    }
+
+    void CommandList::setClipMode(ClipMode mode)
+    {
+        pushInternal(COMMAND_CLIP_MODE, &mode, sizeof(mode));
+    }
+
+    void CommandList::enableFlag(RenderFlag value)
+    {
+        pushInternal(COMMAND_ENABLE_FLAG, &value, sizeof(value));
+    }
+
+    void CommandList::disableFlag(RenderFlag value)
+    {
+        pushInternal(COMMAND_DISABLE_FLAG, &value, sizeof(value));
+    }
+
+    ////////////////////////////////////////
+    //             UNIFORMS               //
+    ////////////////////////////////////////
+
+    // only the used part of UniformCommand is stored
+    static unsigned uniformSize(unsigned floats)
+    {
+        return sizeof(int) + floats * sizeof(float);
+    }
+
+    void CommandList::uniform(int loc, float value)
+    {
+        UniformCommand c;
+        c.loc = loc;
+        c.values[0] = value;
+        pushInternal(COMMAND_UNIFORM_FLOAT, &c, uniformSize(1));
+    }
+
+    void CommandList::uniform(int loc, int value)
+    {
+        UniformCommand c;
+        c.loc = loc;
+        memcpy(c.values, &value, sizeof(value));
+        pushInternal(COMMAND_UNIFORM_INT, &c, uniformSize(1));
+    }
+
+    void CommandList::uniform(int loc, const m3d::vec2& value)
+    {
+        UniformCommand c = {loc, {value.x, value.y}};
+        pushInternal(COMMAND_UNIFORM_VEC2, &c, uniformSize(2));
+    }
+
+    void CommandList::uniform(int loc, const m3d::vec3& value)
+    {
+        UniformCommand c = {loc, {value.x, value.y, value.z}};
+        pushInternal(COMMAND_UNIFORM_VEC3, &c, uniformSize(3));
+    }
+
+    void CommandList::uniform(int loc, const m3d::vec4& value)
+    {
+        UniformCommand c = {loc, {value.x, value.y, value.z, value.w}};
+        pushInternal(COMMAND_UNIFORM_VEC4, &c, uniformSize(4));
+    }
+
+    void CommandList::uniform(int loc, const m3d::mat3x3& value)
+    {
+        UniformCommand c;
+        c.loc = loc;
+        memcpy(c.values, value.m[0], 9 * sizeof(float));
+        pushInternal(COMMAND_UNIFORM_MAT3, &c, uniformSize(9));
+    }
+
+    void CommandList::uniform(int loc, const m3d::mat4x4& value)
+    {
+        UniformCommand c;
+        c.loc = loc;
+        memcpy(c.values, value.m[0], 16 * sizeof(float));
+        pushInternal(COMMAND_UNIFORM_MAT4, &c, uniformSize(16));
+    }
+
+    void CommandList::pushShaderUniformInternal(unsigned type, Shader& shader, UniformHandle handle, const float* values, unsigned count)
+    {
+        ShaderUniformCommand c;
+        c.shader = &shader;
+        c.hash = handle.hash;
+        c.index = handle.index;
+        memcpy(c.values, values, count * sizeof(float));
+        pushInternal(type, &c, offsetof(ShaderUniformCommand, values) + count * sizeof(float));
+    }
+
+    void CommandList::uniform(Shader& shader, UniformHandle handle, float value)
+    {
+        pushShaderUniformInternal(COMMAND_SHADER_UNIFORM_FLOAT, shader, handle, &value, 1);
+    }
+
+    void CommandList::uniform(Shader& shader, UniformHandle handle, int value)
+    {
+        float v;
+        memcpy(&v, &value, sizeof(value));
+        pushShaderUniformInternal(COMMAND_SHADER_UNIFORM_INT, shader, handle, &v, 1);
+    }
+
+    void CommandList::uniform(Shader& shader, UniformHandle handle, const m3d::vec2& value)
+    {
+        float v[2] = {value.x, value.y};
+        pushShaderUniformInternal(COMMAND_SHADER_UNIFORM_VEC2, shader, handle, v, 2);
+    }
+
+    void CommandList::uniform(Shader& shader, UniformHandle handle, const m3d::vec3& value)
+    {
+        float v[3] = {value.x, value.y, value.z};
+        pushShaderUniformInternal(COMMAND_SHADER_UNIFORM_VEC3, shader, handle, v, 3);
+    }
+
+    void CommandList::uniform(Shader& shader, UniformHandle handle, const m3d::vec4& value)
+    {
+        float v[4] = {value.x, value.y, value.z, value.w};
+        pushShaderUniformInternal(COMMAND_SHADER_UNIFORM_VEC4, shader, handle, v, 4);
+    }
+
+    void CommandList::uniform(Shader& shader, UniformHandle handle, const m3d::mat3x3& value)
+    {
+        pushShaderUniformInternal(COMMAND_SHADER_UNIFORM_MAT3, shader, handle, value.m[0], 9);
+    }
+
+    void CommandList::uniform(Shader& shader, UniformHandle handle, const m3d::mat4x4& value)
+    {
+        pushShaderUniformInternal(COMMAND_SHADER_UNIFORM_MAT4, shader, handle, value.m[0], 16);
+    }
+
+    unsigned CommandList::getCommandCount() const
+    {
+        return m_count;
+    }
+
+    unsigned CommandList::getByteSize() const
+    {
+        return m_data.size();
+    }
+
+    ////////////////////////////////////////
+    //              REPLAY                //
+    ////////////////////////////////////////
+
+    // uniforms recorded with a handle go through the shader, the others straight to the location
+    template<typename T>
+    static void setUniformInternal(Shader* shader, UniformHandle handle, int loc, const T& value)
+    {
+        if(shader) shader->uniform(handle, value);
+        else Shader::uniform(loc, value);
+    }
+
+    static bool executeUniformInternal(unsigned type, const unsigned char* payload, unsigned size)
+    {
+        Shader *shader = nullptr;
+        UniformHandle handle(0);
+        int loc = -1;
+        float values[16];
+
+        if(type >= COMMAND_SHADER_UNIFORM_FLOAT)
+        {
+            ShaderUniformCommand c;
+            memcpy(&c, payload, size);
+
+            shader = c.shader;
+            handle = UniformHandle(c.hash, c.index);
+            memcpy(values, c.values, size - offsetof(ShaderUniformCommand, values));
+
+            type = type - COMMAND_SHADER_UNIFORM_FLOAT + COMMAND_UNIFORM_FLOAT;
+        }
+        else
+        {
+            UniformCommand c;
+            memcpy(&c, payload, size);
+
+            loc = c.loc;
+            memcpy(values, c.values, size - sizeof(int));
+        }
+
+        switch(type)
+        {
+        case COMMAND_UNIFORM_FLOAT:
+            setUniformInternal(shader, handle, loc, values[0]);
+            break;
+        case COMMAND_UNIFORM_INT:
+            {
+                int value;
+                memcpy(&value, values, sizeof(value));
+                setUniformInternal(shader, handle, loc, value);
+                break;
+            }
+        case COMMAND_UNIFORM_VEC2:
+            setUniformInternal(shader, handle, loc, m3d::vec2(values[0], values[1]));
+            break;
+        case COMMAND_UNIFORM_VEC3:
+            setUniformInternal(shader, handle, loc, m3d::vec3(values[0], values[1], values[2]));
+            break;
+        case COMMAND_UNIFORM_VEC4:
+            setUniformInternal(shader, handle, loc, m3d::vec4(values[0], values[1], values[2], values[3]));
+            break;
+        case COMMAND_UNIFORM_MAT3:
+            {
+                m3d::mat3x3 m;
+                memcpy(m.m[0], values, 9 * sizeof(float));
+                setUniformInternal(shader, handle, loc, m);
+                break;
+            }
+        case COMMAND_UNIFORM_MAT4:
+            {
+                m3d::mat4x4 m;
+                memcpy(m.m[0], values, 16 * sizeof(float));
+                setUniformInternal(shader, handle, loc, m);
+                break;
+            }
+        default:
+            logError("COMMAND LIST", "unknown command");
+            return false;
+        }
+
+        return true;
+    }
+
+    void CommandList::executeInternal(Renderer& renderer) const
+    {
+        const unsigned char *p = m_data.data();
+        const unsigned char *end = p + m_data.size();
+
+        while(p < end)
+        {
+            CommandHeader header;
+            memcpy(&header, p, sizeof(header));
+            const unsigned char *payload = p + sizeof(header);
+            p = payload + header.size;
+
+            switch(header.type)
+            {
+            case COMMAND_CLEAR:
+                renderer.clear();
+                break;
+            case COMMAND_BEGIN_REGION:
+                {
+                    const char *name;
+                    memcpy(&name, payload, sizeof(name));
+                    renderer.beginRegion(name);
+                    break;
+                }
+            case COMMAND_END_REGION:
+                renderer.endRegion();
+                break;
+            case COMMAND_BIND_MESH:
+                {
+                    const Mesh *mesh;
+                    memcpy(&mesh, payload, sizeof(mesh));
+                    renderer.bindMesh(*mesh);
+                    break;
+                }
+            case COMMAND_BIND_SHADER:
+                {
+                    const Shader *shader;
+                    memcpy(&shader, payload, sizeof(shader));
+                    renderer.bindShader(*shader);
+                    break;
+                }
+            case COMMAND_BIND_TEXTURE:
+                {
+                    TextureCommand c;
+                    memcpy(&c, payload, sizeof(c));
+                    renderer.bindTexture(c.texture, c.slot);
+                    break;
+                }
+            case COMMAND_BIND_FRAMEBUFFER:
+                {
+                    Framebuffer framebuffer;
+                    memcpy(&framebuffer, payload, sizeof(framebuffer));
+                    renderer.bindFramebuffer(framebuffer);
+                    break;
+                }
+            case COMMAND_UNBIND_FRAMEBUFFER:
+                renderer.unbindFramebuffer();
+                break;
+            case COMMAND_DRAW:
+                renderer.drawBoundMesh();
+                break;
+            case COMMAND_DRAW_RANGE:
+                {
+                    unsigned c[2];
+                    memcpy(c, payload, sizeof(c));
+                    renderer.drawBoundMeshRange(c[0], c[1]);
+                    break;
+                }
+            case COMMAND_DRAW_INSTANCED:
+                {
+                    unsigned c[2];
+                    memcpy(c, payload, sizeof(c));
+                    renderer.drawBoundMeshInstanced(c[0], c[1]);
+                    break;
+                }
+            case COMMAND_DRAW_INDIRECT:
+                {
+                    IndirectCommand c;
+                    memcpy(&c, payload, sizeof(c));
+                    renderer.drawIndirect(*c.buffer, c.binding);
+                    break;
+                }
+            case COMMAND_DEPTH_TEST:
+                {
+                    DepthTest func;
+                    memcpy(&func, payload, sizeof(func));
+                    renderer.setDepthTest(func);
+                    break;
+                }
+            case COMMAND_VIEWPORT:
+                {
+                    unsigned c[4];
+                    memcpy(c, payload, sizeof(c));
+                    renderer.setViewport(c[0], c[1], c[2], c[3]);
+                    break;
+                }
+            case COMMAND_CULL_FACE:
+                {
+                    Face face;
+                    memcpy(&face, payload, sizeof(face));
+                    renderer.setCullFace(face);
+                    break;
+                }
+            case COMMAND_CLIP_MODE:
+                {
+                    ClipMode mode;
+                    memcpy(&mode, payload, sizeof(mode));
+                    renderer.setClipMode(mode);
+                    break;
+                }
+            case COMMAND_ENABLE_FLAG:
+            case COMMAND_DISABLE_FLAG:
+                {
+                    RenderFlag flag;
+                    memcpy(&flag, payload, sizeof(flag));
+                    if(header.type == COMMAND_ENABLE_FLAG) renderer.enableFlag(flag);
+                    else renderer.disableFlag(flag);
+                    break;
+                }
+            default:
+                if(!executeUniformInternal(header.type, payload, header.size)) return;
+                break;
+            }
+        }
+    }
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "Frustum.h"
+
 #include <m3d/vec3.h>
 #include <m3d/quat.h>
 #include <m3d/mat4x4.h>
@@ -22,5 +24,6 @@ namespace dgn
         m3d::mat4x4 getProjection() const;
         m3d::mat4x4 getView() const;
         m3d::mat4x4 getInverseView() const;
+        Frustum getFrustum() const;
     };
 }
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Renderer.h"
+
+#include <vector>
+#include <stdint.h>
+
+namespace m3d
+{
+    class vec2;
+    class vec3;
+    class vec4;
+    class mat3x3;
+    class mat4x4;
+}
+
+namespace dgn
+{
+    /**
+        Renderer calls recorded into a compact byte stream without touching gl, replayed later with Renderer::execute.
+        A list may be filled on any thread as long as only one thread uses it at a time, and must be executed on
+        the thread owning the gl context. Meshes, shaders and draw indirect buffers are recorded by pointer and
+        have to stay alive until the list is executed, textures and framebuffers are copied.
+    */
+    class CommandList
+    {
+        friend class Renderer;
+    private:
+        std::vector<unsigned char> m_data;
+        unsigned m_count;
+
+        void pushInternal(unsigned type, const void* payload, unsigned size);
+        void pushShaderUniformInternal(unsigned type, Shader& shader, UniformHandle handle, const float* values, unsigned count);
+        void executeInternal(Renderer& renderer) const;
+
+    public:
+        CommandList();
+
+        /**
+            Removes every command, keeping the memory for the next recording
+        */
+        void reset();
+
+        void clear();
+
+        /**
+            name is recorded by pointer and has to stay alive until the list is executed
+        */
+        void beginRegion(const char* name);
+        void endRegion();
+
+        void bindMesh(const Mesh& mesh);
+        void bindShader(const Shader& shader);
+        void bindTexture(const Texture& texture, unsigned slot);
+        void bindFramebuffer(const Framebuffer& framebuffer);
+        void unbindFramebuffer();
+
+        void drawBoundMesh();
+        void drawBoundMeshRange(unsigned first_index, unsigned count);
+        void drawBoundMeshInstanced(unsigned count, unsigned base_instance = 0);
+        /**
+            The buffer must be uploaded before the list is executed
+        */
+        void drawIndirect(const DrawIndirectBuffer& buffer, unsigned draw_data_binding = 0);
+
+        void setDepthTest(DepthTest func);
+        void setViewport(unsigned x, unsigned y, unsigned width, unsigned height);
+        void setCullFace(Face face);
+        void setClipMode(ClipMode mode);
+        void enableFlag(RenderFlag value);
+        void disableFlag(RenderFlag value);
+
+        void uniform(int loc, float value);
+        void uniform(int loc, int value);
+        void uniform(int loc, const m3d::vec2& value);
+        void uniform(int loc, const m3d::vec3& value);
+        void uniform(int loc, const m3d::vec4& value);
+        void uniform(int loc, const m3d::mat3x3& value);
+        void uniform(int loc, const m3d::mat4x4& value);
+
+        /**
+            Set through Shader::uniform with the handle when replayed, so the shader's value cache stays right.
+            The shader is recorded by pointer and must be the bound one at that point of the list.
+        */
+        void uniform(Shader& shader, UniformHandle handle, float value);
+        void uniform(Shader& shader, UniformHandle handle, int value);
+        void uniform(Shader& shader, UniformHandle handle, const m3d::vec2& value);
+        void uniform(Shader& shader, UniformHandle handle, const m3d::vec3& value);
+        void uniform(Shader& shader, UniformHandle handle, const m3d::vec4& value);
+        void uniform(Shader& shader, UniformHandle handle, const m3d::mat3x3& value);
+        void uniform(Shader& shader, UniformHandle handle, const m3d::mat4x4& value);
+
+        unsigned getCommandCount() const;
+        unsigned getByteSize() const;
+    };
+}
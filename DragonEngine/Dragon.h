@@ -1,12 +1,23 @@
 #pragma once
 
 #include "Camera.h"
+#include "CommandList.h"
+#include "DrawIndirectBuffer.h"
 #include "Framebuffer.h"
+#include "Frustum.h"
+#include "GpuProfiler.h"
+#include "InstanceBuffer.h"
 #include "Input.h"
+#include "MaterialArray.h"
 #include "Mesh.h"
+#include "MeshArena.h"
+#include "MeshOptimizer.h"
+#include "Profiler.h"
 #include "Renderer.h"
+#include "RenderQueue.h"
 #include "Shader.h"
 #include "ShadowMap.h"
 #include "Texture.h"
+#include "UniformBuffer.h"
 #include "Window.h"
 #include "ErrorString.h"
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <vector>
+
+namespace dgn
+{
+    /**
+        Layout of one GL_DRAW_INDIRECT_BUFFER command for glMultiDrawElementsIndirect
+    */
+    struct DrawIndirectCommand
+    {
+        unsigned count;
+        unsigned instance_count;
+        unsigned first_index;
+        int base_vertex;
+        unsigned base_instance;
+    };
+
+    /**
+        A list of draws submitted with a single Renderer::drawIndirect call. Every mesh added must come from the
+        same MeshArena, so one vertex array serves all of them. Intended to hold one bucket of draws sharing a shader
+        and textures.
+
+        Each draw may carry draw_data_stride bytes of data, stored in a shader storage buffer in draw order.
+        Shaders index it with gl_DrawIDARB (ARB_shader_draw_parameters):
+            layout(std430, binding = 0) readonly buffer DrawData { Draw draws[]; };
+            Draw draw = draws[gl_DrawIDARB];
+    */
+    class DrawIndirectBuffer
+    {
+        friend class Renderer;
+    private:
+        unsigned m_command_buffer;
+        unsigned m_draw_buffer;
+
+        unsigned m_max_draws;
+        unsigned m_draw_stride;
+
+        // vertex state shared by every draw, taken from the first mesh added
+        unsigned m_vao;
+        unsigned m_position_vao;
+        unsigned m_ibo;
+        unsigned m_instance_mask;
+        IndexType m_index_type;
+
+        std::vector<DrawIndirectCommand> m_commands;
+        std::vector<unsigned char> m_draw_data;
+        unsigned m_uploaded;
+
+    public:
+        DrawIndirectBuffer();
+        void dispose();
+
+        DrawIndirectBuffer& create(unsigned max_draws, unsigned draw_data_stride = 0);
+
+        /**
+            Removes every draw, the buffer keeps its vertex state until another mesh is added
+        */
+        void clear();
+
+        /**
+            Appends a draw of the whole mesh. draw_data must point to draw_data_stride bytes, or be nullptr to zero them.
+            Returns false if the buffer is full or the mesh does not share vertex state with the draws already added.
+        */
+        bool addDraw(const Mesh& mesh, const void* draw_data = nullptr, unsigned instance_count = 1, unsigned base_instance = 0);
+
+        /**
+            Copies the draws added since the last upload to the gpu, must be called before Renderer::drawIndirect
+        */
+        void upload();
+
+        unsigned getDrawCount() const;
+        unsigned getMaxDraws() const;
+    };
+}
@@ -3,4 +3,24 @@
 namespace dgn
 {
     const char *getErrorString();
+
+    enum class DebugMode
+    {
+        // no error reporting from gl
+        None,
+        // glGetError before and after every gl call, only available in debug builds
+        GetError,
+        // KHR_debug callback, messages may arrive on a driver thread some time after the call that caused them
+        Async,
+        // KHR_debug callback run inside the offending call, debug builds also report the file and line of the call
+        Synchronous
+    };
+
+    /**
+        Selects how gl errors are reported. Needs a current context, Renderer::initialize picks Synchronous
+        in debug builds and Async otherwise. Returns false if the mode is unavailable: without KHR_debug it
+        falls back to GetError in debug builds and None otherwise, GetError itself is refused in release builds.
+    */
+    bool setDebugMode(DebugMode mode);
+    DebugMode getDebugMode();
 }
@@ -26,6 +26,10 @@ namespace dgn
         Framebuffer& setDepthAttachment(Texture texture, unsigned mip = 0);
         Framebuffer& setDepthAttachment(Texture texture, unsigned layer, unsigned mip = 0);
         Framebuffer& setDepthAttachment(Texture texture, CubemapFace face, unsigned mip = 0);
+        /**
+            Attaches every layer of an array or cube texture, shaders pick the layer with gl_Layer
+        */
+        Framebuffer& setDepthAttachmentLayered(Texture texture, unsigned mip = 0);
 
         Framebuffer& createDepthBit(unsigned width, unsigned height);
         Framebuffer& removeDepthBit();
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <m3d/vec3.h>
+#include <m3d/mat4x4.h>
+
+#include <vector>
+
+namespace dgn
+{
+    /**
+        Six planes (a, b, c, d) in the order left, right, bottom, top, near, far with normals pointing inwards.
+        A point p is inside a plane when a * p.x + b * p.y + c * p.z + d >= 0.
+    */
+    class Frustum
+    {
+    public:
+        float planes[6][4];
+
+        Frustum();
+
+        /**
+            Extracts the planes of -w <= x, y, z <= w from a view projection matrix. For projections with
+            zero to one depth the near plane ends up behind the real one, so tests stay conservative.
+        */
+        static Frustum fromMatrix(const m3d::mat4x4& view_projection);
+
+        bool testAABB(const m3d::vec3& min, const m3d::vec3& max) const;
+        bool testSphere(const m3d::vec3& center, float radius) const;
+    };
+
+    struct CullStats
+    {
+        unsigned drawn = 0;
+        unsigned culled = 0;
+    };
+
+    /**
+        World space boxes kept as a structure of arrays so a frustum is tested against four boxes at a time.
+        Boxes are identified by the index add returned.
+    */
+    class CullingSet
+    {
+    private:
+        std::vector<float> m_center_x;
+        std::vector<float> m_center_y;
+        std::vector<float> m_center_z;
+        std::vector<float> m_extent_x;
+        std::vector<float> m_extent_y;
+        std::vector<float> m_extent_z;
+
+    public:
+        void clear();
+
+        unsigned add(const m3d::vec3& min, const m3d::vec3& max);
+        unsigned add(const MeshBounds& bounds);
+        /**
+            Adds the box around bounds.min and bounds.max once transformed by model
+        */
+        unsigned add(const MeshBounds& bounds, const m3d::mat4x4& model);
+        void set(unsigned index, const MeshBounds& bounds, const m3d::mat4x4& model);
+
+        unsigned size() const;
+
+        /**
+            Replaces visible with the indices of every box at least partly inside frustum, in increasing order
+        */
+        CullStats cull(const Frustum& frustum, std::vector<unsigned>& visible) const;
+    };
+}
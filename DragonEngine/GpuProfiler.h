@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+namespace dgn
+{
+    /**
+        Rolling gpu times of one named scope, in milliseconds
+    */
+    struct GpuTimingStats
+    {
+        unsigned samples = 0;
+        float last = 0;
+        float average = 0;
+        float min = 0;
+        float max = 0;
+        float p50 = 0;
+        float p95 = 0;
+        float p99 = 0;
+    };
+
+    /**
+        Measures named gpu scopes with timestamp queries. Each frame in flight owns its own queries, and a
+        frame's results are read back frames_in_flight frames later, when the gpu is long done with them,
+        so reading never stalls. Scopes may nest.
+
+        Typical use:
+            profiler.beginFrame();
+            profiler.beginScope("shadows");
+            ...
+            profiler.endScope();
+            profiler.endFrame();
+    */
+    class GpuProfiler
+    {
+    private:
+        struct Sample
+        {
+            unsigned scope;
+            unsigned begin_query;
+            unsigned end_query;
+        };
+
+        struct Frame
+        {
+            std::vector<unsigned> queries;
+            std::vector<Sample> samples;
+            unsigned used_queries = 0;
+        };
+
+        struct Scope
+        {
+            std::string name;
+            // ring of the last history times
+            std::vector<float> times;
+            unsigned next = 0;
+            unsigned count = 0;
+        };
+
+        std::vector<Frame> m_frames;
+        std::vector<Scope> m_scopes;
+        std::vector<unsigned> m_open;
+        // per scope sum of a frame's samples while resolving it
+        std::vector<double> m_totals;
+
+        unsigned m_frame;
+        unsigned m_history;
+        unsigned m_dropped;
+        bool m_recording;
+
+        unsigned queryInternal(Frame& frame);
+        unsigned scopeInternal(const char* name);
+        void resolveInternal(Frame& frame);
+
+    public:
+        GpuProfiler();
+        void dispose();
+
+        GpuProfiler& create(unsigned frames_in_flight = 3, unsigned history = 128);
+
+        /**
+            Reads back the results of the frame recorded frames_in_flight frames ago and starts recording
+        */
+        void beginFrame();
+        void endFrame();
+
+        void beginScope(const char* name);
+        void endScope();
+
+        unsigned getScopeCount() const;
+        const char *getScopeName(unsigned index) const;
+        GpuTimingStats getStats(unsigned index) const;
+        GpuTimingStats getStats(const char* name) const;
+        /**
+            Frames whose queries were not ready when read back, their samples are dropped instead of waited on
+        */
+        unsigned getDroppedFrames() const;
+
+        /**
+            One row or object per scope with the current stats, returns false if the file could not be written
+        */
+        bool writeCSV(const char* filepath) const;
+        bool writeJSON(const char* filepath) const;
+    };
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <vector>
+
+namespace dgn
+{
+    /**
+        Persistently mapped per-instance vertex data, refilled every frame without stalling.
+        The buffer is split into one region per frame in flight and each region is fenced once the
+        next one begins, so the CPU only waits if it gets more than frames_in_flight frames ahead.
+        Without buffer storage (gl 4.4) instances are written to a cpu copy and uploaded by end() into a
+        single orphaned region instead.
+
+        Typical use once per frame:
+            InstanceData *data = (InstanceData*)buffer.begin();
+            ... write up to getMaxInstances() instances ...
+            buffer.end(count);
+            renderer.bindMesh(mesh);
+            renderer.drawBoundMeshInstanced(buffer.getCount(), buffer.getBaseInstance());
+    */
+    class InstanceBuffer
+    {
+        friend class Mesh;
+    private:
+        struct Attrib
+        {
+            unsigned location;
+            int size;
+            AttribType type;
+            bool normalized;
+            bool integer;
+            unsigned offset;
+        };
+
+        unsigned m_buffer;
+        unsigned char *m_mapped;
+        bool m_persistent;
+        std::vector<unsigned char> m_staging;
+        std::vector<void*> m_fences;
+
+        unsigned m_stride;
+        unsigned m_max_instances;
+        unsigned m_frames;
+
+        unsigned m_region;
+        unsigned m_count;
+        unsigned m_offset;
+
+        std::vector<Attrib> m_attribs;
+
+    public:
+        InstanceBuffer();
+        void dispose();
+
+        InstanceBuffer& create(unsigned instance_stride, unsigned max_instances, unsigned frames_in_flight = 3);
+
+        InstanceBuffer& addInstanceAttrib(unsigned location, int size, AttribType type = AttribType::Float, bool normalized = false);
+        InstanceBuffer& addInstanceIntAttrib(unsigned location, int size, AttribType type);
+        /**
+            Adds a 4x4 float matrix in locations location to location + 3, one row per location.
+            m3d::mat4x4 is row major, so the shader builds it with transpose(mat4(row0, row1, row2, row3)).
+        */
+        InstanceBuffer& addInstanceMatrix(unsigned location);
+
+        /**
+            Moves to the next region and returns a pointer to write this frame's instances into
+        */
+        void* begin();
+        void end(unsigned count);
+
+        unsigned getCount() const;
+        unsigned getBaseInstance() const;
+        unsigned getMaxInstances() const;
+    };
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Texture.h"
+
+#include <string>
+
+namespace dgn
+{
+    enum class MaterialMap
+    {
+        Color = 0,
+        Roughness,
+        Metalness,
+        Normal,
+        AO
+    };
+
+    /**
+        PBR materials packed into one 2D array texture per map, so every material of a size shares five
+        textures and a material is only a layer index. Shaders sample each map with sampler2DArray at
+        vec3(uv, material), and the index can come from a uniform, per draw data or an instance attribute.
+
+        Typical use:
+            materials.create(1024, 1024, 8);
+            unsigned bricks = materials.addMaterial(bricks_paths);
+            ...
+            materials.complete();
+            for each map: renderer.bindTexture(materials.getMap(map), slot);
+    */
+    class MaterialArray
+    {
+    public:
+        static const unsigned MAP_COUNT = 5;
+        // returned by addMaterial when every layer is taken
+        static const unsigned INVALID_MATERIAL = ~0u;
+
+    private:
+        Texture m_maps[MAP_COUNT];
+        unsigned m_width;
+        unsigned m_height;
+        unsigned m_count;
+        unsigned m_max_materials;
+        float m_anisotropy;
+
+        void fillInternal(unsigned map, unsigned layer, const unsigned char value[4]);
+
+    public:
+        MaterialArray();
+        void dispose();
+
+        MaterialArray& create(unsigned width, unsigned height, unsigned max_materials, float anisotropy = -1.0f);
+
+        /**
+            Loads one png per map in MaterialMap order into the next free layer. A 1x1 png fills the layer with
+            its pixel. Empty paths and files of the wrong size get the map's neutral value: white color,
+            roughness and ao, no metalness, a flat normal.
+            Returns the material's layer, or INVALID_MATERIAL if the array is full.
+        */
+        unsigned addMaterial(const std::string filepaths[MAP_COUNT]);
+
+        /**
+            Builds the mipmaps, call once after the last material is added
+        */
+        MaterialArray& complete();
+
+        const Texture& getMap(MaterialMap map) const;
+        unsigned getMaterialCount() const;
+    };
+}
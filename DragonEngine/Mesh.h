@@ -2,29 +2,116 @@
 
 #include <vector>
 #include <string>
+#include <stdint.h>
 
-namespace m3d
-{
-    class vec3;
-}
+#include <m3d/vec3.h>
 
 namespace dgn
 {
+    struct MeshOptimizeStats;
+    class MeshArena;
+    class InstanceBuffer;
+
+    enum class AttribType
+    {
+        Byte                  = 0x1400,
+        UnsignedByte          = 0x1401,
+        Short                 = 0x1402,
+        UnsignedShort         = 0x1403,
+        Float                 = 0x1406,
+        HalfFloat             = 0x140B,
+        Int2_10_10_10         = 0x8D9F,
+        UnsignedInt2_10_10_10 = 0x8368
+    };
+
+    enum class IndexType
+    {
+        UnsignedShort = 0x1403,
+        UnsignedInt   = 0x1405
+    };
+
+    unsigned indexTypeSize(IndexType type);
+    unsigned attribTypeSize(AttribType type, int size);
+
+    /**
+        Local space axis aligned box and bounding sphere of a mesh
+    */
+    struct MeshBounds
+    {
+        m3d::vec3 min;
+        m3d::vec3 max;
+        m3d::vec3 center;
+        float radius = 0.0f;
+    };
+
+    struct MeshImportSettings
+    {
+        // cook imported meshes into filepath + ".dmesh" and map that file on later loads
+        bool use_cache = true;
+        // reorder indices and vertices for the post-transform cache, overdraw and vertex fetch
+        bool optimize = true;
+        // keep a separate position only stream for depth passes, see Mesh::createPositionStream
+        bool position_stream = true;
+        // allocate meshes matching the arena's vertex format from it instead of creating their own buffers
+        MeshArena *arena = nullptr;
+    };
+
     class Mesh
     {
         friend class Renderer;
+        friend class MeshArena;
+        friend class DrawIndirectBuffer;
     public:
         Mesh();
         virtual ~Mesh();
         void dispose();
 
         Mesh& createFromData(const std::vector<float>& vertex_data, const std::vector<unsigned>& index_data);
+        Mesh& createFromData(const std::vector<float>& vertex_data, const std::vector<uint16_t>& index_data);
+        Mesh& createFromData(const void* vertex_data, unsigned vertex_bytes, const void* index_data, unsigned index_count, IndexType index_type);
         Mesh& createFromData(const std::vector<unsigned>& index_data);
         Mesh& setVertexSize(unsigned size);
-        Mesh& addVertexAttrib(unsigned location, int size);
+        Mesh& setVertexStride(unsigned bytes);
+        Mesh& addVertexAttrib(unsigned location, int size, AttribType type = AttribType::Float, bool normalized = false);
+        Mesh& setBounds(const MeshBounds& bounds);
         Mesh& complete();
 
-        static std::vector<Mesh> loadFromFile(std::string filepath);
+        /**
+            Adds a tightly packed copy of attribute 0 with its own vertex array, must be called after complete.
+            The Renderer draws from it instead of the interleaved vertices whenever the bound shader only reads attribute 0.
+        */
+        Mesh& createPositionStream(const void* position_data, unsigned position_bytes, int size, AttribType type = AttribType::Float, bool normalized = false);
+
+        /**
+            Sources the instance buffer's attributes once per instance, for Renderer::drawBoundMeshInstanced.
+            Must be called after complete and createPositionStream. Meshes from the same MeshArena share a vertex array,
+            so the stream applies to all of them.
+        */
+        Mesh& addInstanceStream(const InstanceBuffer& instances);
+
+        bool hasPositionStream() const;
+        bool isArenaAllocated() const;
+        IndexType getIndexType() const;
+        /**
+            Computed on import, meshes created from data have empty bounds until setBounds is called
+        */
+        const MeshBounds& getBounds() const;
+
+        /**
+            Bounds of vertex_count positions, each stride floats after the previous one
+        */
+        static MeshBounds computeBounds(const float* positions, unsigned vertex_count, unsigned stride);
+
+        /**
+            Loads every mesh in the given file. The mesh cache is rebuilt whenever the source file's
+            size or modification time, or the import settings, change.
+        */
+        static std::vector<Mesh> loadFromFile(std::string filepath, MeshImportSettings settings = MeshImportSettings());
+
+        /**
+            Imports the given file and returns the vertex cache efficiency of each mesh before and after optimization
+        */
+        static std::vector<MeshOptimizeStats> loadOptimizeStats(std::string filepath);
 
         /**
             Returns a vector of all positions of vertices loaded from given filepath
@@ -35,13 +122,31 @@ namespace dgn
         unsigned m_vao;
         unsigned m_vbo;
         unsigned m_ibo;
+        unsigned m_position_vao;
+        unsigned m_position_vbo;
         unsigned m_length;
+        IndexType m_index_type;
+
+        // offsets into shared buffers for meshes allocated from a MeshArena
+        unsigned m_first_index;
+        int m_base_vertex;
+        bool m_arena_allocated;
+
+        // attribute locations sourced per instance
+        unsigned m_instance_mask;
 
         unsigned vert_size;
         unsigned vert_offsets;
 
+        MeshBounds m_bounds;
+
         bool m_disposed;
     };
 
     typedef std::vector<Mesh> Model;
+
+    /**
+        Box around every mesh's box and sphere around every mesh's sphere
+    */
+    MeshBounds modelBounds(const Model& model);
 }
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Mesh.h"
+
+namespace dgn
+{
+    /**
+        One immutable vertex buffer, index buffer and vertex array shared by every mesh of a single vertex format.
+        Meshes allocated from the arena keep an index offset and base vertex into the shared buffers, so switching
+        between them needs no vertex array change. Allocation is a bump allocator, space is only reclaimed by dispose.
+    */
+    class MeshArena
+    {
+    private:
+        struct Attrib
+        {
+            unsigned location;
+            int size;
+            AttribType type;
+            bool normalized;
+        };
+
+        unsigned m_vao;
+        unsigned m_vbo;
+        unsigned m_ibo;
+        unsigned m_position_vao;
+        unsigned m_position_vbo;
+
+        unsigned m_vertex_stride;
+        unsigned m_position_stride;
+        unsigned m_vertex_capacity;
+        unsigned m_index_capacity;
+        IndexType m_index_type;
+
+        unsigned m_vertex_count;
+        unsigned m_index_count;
+
+        std::vector<Attrib> m_attribs;
+
+    public:
+        MeshArena();
+        void dispose();
+
+        /**
+            vertex_capacity and index_capacity are counts, not bytes
+        */
+        MeshArena& create(unsigned vertex_stride, unsigned vertex_capacity, unsigned index_capacity, IndexType index_type = IndexType::UnsignedShort);
+        MeshArena& addVertexAttrib(unsigned location, int size, AttribType type = AttribType::Float, bool normalized = false);
+        /**
+            Adds a position only buffer and vertex array sharing the arena's base vertices, see Mesh::createPositionStream.
+            Attribute 0 must already be added.
+        */
+        MeshArena& addPositionStream();
+        MeshArena& complete();
+
+        unsigned getVertexStride() const;
+        unsigned getVertexAttribCount() const;
+        bool hasVertexAttrib(unsigned location, int size, AttribType type, bool normalized) const;
+        bool hasPositionStream() const;
+
+        /**
+            Copies the given data into the arena. positions may be nullptr if the arena has no position stream.
+            Returns false and leaves mesh untouched if the arena is out of space or the index type can't be stored.
+        */
+        bool allocate(Mesh& mesh, const void* vertex_data, unsigned vertex_count, const void* index_data, unsigned index_count,
+                      IndexType index_type, const void* position_data = nullptr);
+
+        unsigned getVertexCount() const;
+        unsigned getIndexCount() const;
+        unsigned getVertexCapacity() const;
+        unsigned getIndexCapacity() const;
+    };
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+namespace dgn
+{
+    struct VertexCacheStats
+    {
+        // average cache misses per triangle
+        float acmr;
+        // average cache misses per referenced vertex, 1.0 is optimal
+        float atvr;
+    };
+
+    struct MeshOptimizeStats
+    {
+        VertexCacheStats before;
+        VertexCacheStats after;
+    };
+
+    /**
+        Index and vertex reordering for triangle lists. The usual order is
+        optimizeVertexCache, then optimizeOverdraw, then optimizeVertexFetch.
+    */
+    class MeshOptimizer
+    {
+    public:
+        /**
+            Simulates a FIFO post-transform cache of the given size over a triangle list
+        */
+        static VertexCacheStats analyzeVertexCache(const unsigned* indices, unsigned index_count, unsigned vertex_count, unsigned cache_size = 16);
+
+        /**
+            Reorders triangles for post-transform cache locality (Forsyth's linear-speed algorithm).
+            destination may not alias indices.
+        */
+        static void optimizeVertexCache(unsigned* destination, const unsigned* indices, unsigned index_count, unsigned vertex_count);
+
+        /**
+            Reorders clusters of a cache optimized triangle list so outward facing clusters are drawn first.
+            A cluster is only split where the cache would be cold anyway, so cache efficiency is kept
+            within threshold times the input ACMR.
+            positions is the start of a float position stream with stride floats between vertices.
+        */
+        static void optimizeOverdraw(unsigned* indices, unsigned index_count, const float* positions, unsigned stride,
+                                     unsigned vertex_count, float threshold = 1.05f);
+
+        /**
+            Reorders vertices by first use in the index buffer and rewrites the indices to match.
+            Vertices never referenced are dropped. Returns the new vertex count.
+        */
+        static unsigned optimizeVertexFetch(float* vertices, unsigned* indices, unsigned index_count, unsigned vertex_count, unsigned vertex_size);
+    };
+}
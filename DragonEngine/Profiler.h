@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace dgn
+{
+    /**
+        Turns cpu profiling on or off for every thread. While off a scope costs a call and a relaxed atomic load.
+    */
+    void setCpuProfiling(bool enabled);
+    bool isCpuProfiling();
+
+    /**
+        Drops every recorded scope, only call while no thread is inside a profiled scope
+    */
+    void clearCpuTrace();
+
+    /**
+        Writes every recorded scope as chrome trace_event json, viewable in chrome://tracing or Perfetto.
+        Returns false if the file could not be written.
+    */
+    bool writeCpuTrace(const char* filepath);
+
+    /**
+        Times the enclosing block, use through DGN_PROFILE_SCOPE. name is kept by pointer and has to be
+        a string literal or otherwise outlive the trace.
+    */
+    class ProfileScope
+    {
+    private:
+        const char *m_name;
+        uint64_t m_start;
+
+    public:
+        ProfileScope(const char* name);
+        ~ProfileScope();
+
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator=(const ProfileScope&) = delete;
+    };
+}
+
+#define DGN_PROFILE_CONCAT_INTERNAL(a, b) a##b
+#define DGN_PROFILE_CONCAT(a, b) DGN_PROFILE_CONCAT_INTERNAL(a, b)
+
+// define DGN_NO_PROFILE to compile every scope out
+#ifndef DGN_NO_PROFILE
+#define DGN_PROFILE_SCOPE(name) dgn::ProfileScope DGN_PROFILE_CONCAT(dgn_profile_scope_, __LINE__)(name)
+#else
+#define DGN_PROFILE_SCOPE(name)
+#endif
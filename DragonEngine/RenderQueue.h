@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Mesh.h"
+#include "Shader.h"
+#include "Texture.h"
+
+#include <m3d/vec3.h>
+#include <m3d/mat4x4.h>
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+namespace dgn
+{
+    class Renderer;
+
+    struct RenderItem
+    {
+        const Mesh *mesh = nullptr;
+        const Shader *shader = nullptr;
+        // bound to texture slots 0 to texture_count - 1, items sharing the pointer share a material
+        const Texture *textures = nullptr;
+        unsigned texture_count = 0;
+        m3d::mat4x4 transform = m3d::mat4x4(1.0f);
+        // uniforms set from transform when replayed, -1 to skip
+        int model_uniform = -1;
+        int mvp_uniform = -1;
+        // free for the caller, e.g. an index into its own arrays
+        unsigned user = 0;
+    };
+
+    /**
+        Items sorted by a 64 bit key made of, from the highest bits down:
+            pass      4 bits
+            shader   12 bits
+            material 16 bits
+            depth    32 bits, distance from the view position to the mesh's bounding sphere center
+        so each pass replays grouped by shader, then material, then front to back.
+    */
+    class RenderQueue
+    {
+    private:
+        std::vector<RenderItem> m_items;
+        std::vector<uint64_t> m_keys;
+        std::vector<uint32_t> m_order;
+
+        // scratch buffers for the radix sort
+        std::vector<uint64_t> m_keys_temp;
+        std::vector<uint32_t> m_order_temp;
+
+        // small ids for the key, kept between frames so equal state keeps its place
+        std::unordered_map<const void*, unsigned> m_shader_ids;
+        std::unordered_map<const void*, unsigned> m_material_ids;
+
+        m3d::vec3 m_view_position;
+
+        unsigned idInternal(std::unordered_map<const void*, unsigned>& ids, const void* ptr, unsigned max);
+
+    public:
+        static const unsigned MAX_PASSES = 16;
+
+        void clear();
+        void setViewPosition(const m3d::vec3& position);
+
+        /**
+            Adds an item to pass. Transparent items should be submitted back_to_front.
+        */
+        void submit(unsigned pass, const RenderItem& item, bool back_to_front = false);
+
+        /**
+            LSD radix sort on the keys, must be called after the last submit and before reading or replaying items
+        */
+        void sort();
+
+        unsigned size() const;
+        /**
+            The index-th item in sorted order
+        */
+        const RenderItem& getItem(unsigned index) const;
+
+        /**
+            Binds and draws every item of pass in sorted order. State already bound by the previous item is skipped.
+        */
+        void execute(Renderer& renderer, unsigned pass, const m3d::mat4x4& view_projection) const;
+    };
+}
@@ -1,12 +1,17 @@
 #pragma once
 
 #include "Mesh.h"
+#include "DrawIndirectBuffer.h"
 #include "Shader.h"
 #include "Texture.h"
 #include "Framebuffer.h"
+#include "UniformBuffer.h"
 
 namespace dgn
 {
+    class CommandList;
+    class GpuProfiler;
+
     enum class DepthTest
     {
        Never = 0,
@@ -86,30 +91,106 @@ namespace dgn
         ZeroToOne
     };
 
+    /**
+        State changes requested from the Renderer, split into those forwarded to gl and those dropped
+        because the state was already set
+    */
+    struct RenderStateStats
+    {
+        unsigned issued = 0;
+        unsigned elided = 0;
+    };
+
     class Renderer
     {
     private:
         unsigned clear_flags = 0;
         DrawMode draw_mode = DrawMode::Triangles;
         unsigned bound_mesh_size = 0;
+        IndexType bound_index_type = IndexType::UnsignedInt;
+        unsigned bound_first_index = 0;
+        int bound_base_vertex = 0;
+
+        unsigned bound_vao = 0;
+        unsigned bound_position_vao = 0;
+        unsigned bound_ibo = 0;
+        unsigned bound_attrib_mask = ~0u;
+        unsigned bound_instance_mask = 0;
+
+        // shadow copy of gl state, UNKNOWN_STATE wherever the real state may differ
+        static const unsigned UNKNOWN_STATE = ~0u;
+        static const unsigned MAX_TEXTURE_UNITS = 32;
+        static const unsigned MAX_UNIFORM_BINDINGS = 16;
+        static const unsigned RENDER_FLAG_COUNT = 8;
+
+        unsigned state_generation = UNKNOWN_STATE;
+        unsigned current_program;
+        unsigned current_vao;
+        unsigned current_ibo;
+        unsigned current_framebuffer;
+        unsigned current_texture_unit;
+        unsigned current_textures[MAX_TEXTURE_UNITS];
+        unsigned current_uniform_buffers[MAX_UNIFORM_BINDINGS];
+        unsigned current_viewport[4];
+        unsigned current_depth_func;
+        unsigned current_cull_face;
+        unsigned current_winding;
+        unsigned current_clip_mode;
+        unsigned current_blend[2];
+        unsigned current_flags[RENDER_FLAG_COUNT];
+
+        RenderStateStats state_stats;
+        GpuProfiler *profiler = nullptr;
+
+        bool positionOnlyInternal() const;
+        void bindVertexArrayInternal();
+        void syncStateInternal();
+        bool changeStateInternal(unsigned& current, unsigned value);
+        void activeTextureInternal(unsigned slot);
 
     public:
         bool initialize();
         void terminate();
 
         void clear();
+        /**
+            Blocks until every issued gl command has completed
+        */
+        void finish() const;
 
         void bindMesh(const Mesh& mesh);
-        void bindShader(const Shader& shader) const;
-        void bindTexture(const Texture& texture, unsigned slot) const;
-        void bindFramebuffer(const Framebuffer& framebuffer) const;
+        void bindShader(const Shader& shader);
+        void bindTexture(const Texture& texture, unsigned slot);
+        void bindFramebuffer(const Framebuffer& framebuffer);
+        /**
+            Binds to a uniform block binding point, see Shader::bindUniformBlock
+        */
+        void bindUniformBuffer(const UniformBuffer& buffer, unsigned binding);
 
         void unbindMesh();
-        void unbindShader() const;
-        void unbindTexture(unsigned slot) const;
-        void unbindFramebuffer() const;
+        void unbindShader();
+        void unbindTexture(unsigned slot);
+        void unbindFramebuffer();
 
         void drawBoundMesh() const;
+        /**
+            Draws count indices starting at first_index, relative to the start of the bound mesh
+        */
+        void drawBoundMeshRange(unsigned first_index, unsigned count) const;
+        /**
+            Draws the bound mesh count times. Attributes added with Mesh::addInstanceStream start at base_instance,
+            see InstanceBuffer::getBaseInstance.
+        */
+        void drawBoundMeshInstanced(unsigned count, unsigned base_instance = 0) const;
+        /**
+            Binds the vertex state shared by the buffer's draws and submits all of them with one glMultiDrawElementsIndirect.
+            Per draw data is bound as a shader storage buffer at draw_data_binding. Leaves the arena's mesh state bound.
+        */
+        void drawIndirect(const DrawIndirectBuffer& buffer, unsigned draw_data_binding = 0);
+        /**
+            Replays a recorded command list, must be called on the thread owning the gl context
+        */
+        void execute(const CommandList& commands);
 
         void setDepthTest(DepthTest func);
         void setClearColor(float red, float green, float blue);
@@ -126,5 +207,20 @@ namespace dgn
 
         void enableFlag(RenderFlag value);
         void disableFlag(RenderFlag value);
+
+        /**
+            Forgets the cached gl state, call after changing bindings or render state with gl directly
+        */
+        void invalidateState();
+        const RenderStateStats& getStateStats() const;
+        void resetStateStats();
+
+        /**
+            Regions tag the binds and draws between beginRegion and endRegion with a name. They show up as
+            debug groups in gl debuggers and, with a profiler set, are timed as its scopes. Regions may nest.
+        */
+        void setProfiler(GpuProfiler* gpu_profiler);
+        void beginRegion(const char* name);
+        void endRegion();
     };
 }
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace m3d
 {
@@ -14,26 +18,158 @@ namespace m3d
 
 namespace dgn
 {
+    /**
+        FNV-1a of a uniform or block name, usable at compile time
+    */
+    constexpr uint32_t hashUniformName(const char* str, size_t length, uint32_t hash = 2166136261u)
+    {
+        return length ? hashUniformName(str + 1, length - 1, (hash ^ (unsigned char)*str) * 16777619u) : hash;
+    }
+
+    /**
+        A uniform named by the hash of its name, so no string is built or looked up by gl when it is set.
+        "uMVP"_u is computed at compile time, elements of arrays are picked with [], "uIrrad"_u[1].
+        Handles stay valid when the shader is reloaded.
+    */
+    struct UniformHandle
+    {
+        uint32_t hash;
+        unsigned index;
+
+        constexpr explicit UniformHandle(uint32_t hash, unsigned index = 0) : hash(hash), index(index) {}
+
+        constexpr UniformHandle operator[](unsigned i) const
+        {
+            return UniformHandle(hash, index + i);
+        }
+    };
+
+    inline namespace literals
+    {
+        constexpr UniformHandle operator"" _u(const char* str, size_t length)
+        {
+            return UniformHandle(hashUniformName(str, length));
+        }
+    }
+
+    struct ProgramCacheStats
+    {
+        unsigned hits = 0;
+        unsigned misses = 0;
+        // binaries the driver refused, rebuilt from source
+        unsigned stale = 0;
+    };
+
     class Shader
     {
         friend class Renderer;
 
     private:
         unsigned m_program;
+        // bit per active vertex attribute location
+        unsigned m_attrib_mask;
+        // reapplied whenever the program is rebuilt
+        std::unordered_map<std::string, unsigned> m_block_bindings;
+
+        // program handed to the driver and not yet checked, m_program stays in use until it is
+        struct PendingProgramInternal;
+        std::shared_ptr<PendingProgramInternal> m_pending;
+        Shader* m_fallback;
+
+        // One entry per active uniform and array element, elements of an array follow each other.
+        // The value last set through a handle is kept so setting it again does nothing.
+        struct UniformInternal
+        {
+            int location;
+            // elements after this one in its array
+            unsigned remaining;
+            // 0 until a value is set through a handle
+            unsigned value_size;
+            unsigned char value[64];
+        };
+
+        std::vector<UniformInternal> m_uniforms;
+        // name hash to m_uniforms index, sorted by hash. Arrays are found by name and name[0], elements by name[i]
+        std::vector<std::pair<uint32_t, unsigned>> m_uniform_lookup;
+        // name hash to uniform block index, sorted by hash
+        std::vector<std::pair<uint32_t, unsigned>> m_blocks;
+
+        void reflectInternal();
+        UniformInternal* findUniformInternal(UniformHandle handle);
+        int cacheUniformInternal(UniformHandle handle, const void* value, unsigned size);
+
+        void bindUniformBlockInternal(const std::string& name, unsigned binding);
 
         static std::unordered_map<std::string, int> econst_ints;
+        static std::string program_cache_dir;
 
-        unsigned genShaderInternal(std::string data, unsigned shader_type);
+        /**
+            Expands #include, #pragma once and econst in every stage, then loads the program from the
+            program cache or compiles it. names are the files compile errors are reported against.
+        */
+        Shader& linkInternal(const std::string code[3], const std::string names[3]);
+
+        /**
+            Starts the compile and link without reading any status back, finishInternal checks the result,
+            writes the program cache and swaps the program in
+        */
+        void beginInternal(const std::string code[3], const std::string names[3]);
+        void finishInternal();
+        void discardPendingInternal();
 
     public:
         Shader();
+        // the pending program belongs to one shader, a copy could finish or discard it twice
+        Shader(const Shader&) = delete;
+        Shader& operator=(const Shader&) = delete;
 
         void dispose();
 
         Shader& createFromData(std::string vertex_code, std::string geometry_code, std::string fragment_code);
         Shader& loadFromFiles(std::string vertex_path, std::string geometry_path, std::string fragment_path);
 
-        int getUniformLocation(std::string name) const;
+        /**
+            Like createFromData and loadFromFiles, but return once the stages are handed to the driver.
+            With KHR_parallel_shader_compile the driver compiles on its own threads, so every program can be
+            started up front and checked later. Starting a new load drops one still pending.
+        */
+        Shader& createFromDataAsync(std::string vertex_code, std::string geometry_code, std::string fragment_code);
+        Shader& loadFromFilesAsync(std::string vertex_path, std::string geometry_path, std::string fragment_path);
+
+        /**
+            True once no program is pending. Finishes the program when the driver reports it done, without
+            the extension it has no way to ask and finishes it right away.
+        */
+        bool isReady();
+
+        /**
+            Waits for the pending program, if any, and swaps it in
+        */
+        Shader& finish();
+
+        /**
+            Shader bound in place of this one until its first program is ready, or when that program fails to
+            build. Uniforms set through handles go to the fallback meanwhile, locations from getUniformLocation
+            only exist once the program is finished.
+        */
+        Shader& setFallback(Shader* fallback);
+
+        /**
+            The shader Renderer::bindShader binds for this one: this shader once it has a program, the
+            previous one is kept while a reload is pending, otherwise the fallback if there is one
+        */
+        const Shader& getActive() const;
+
+        /**
+            Location from the table built at link time, -1 and an error if the program has no such uniform
+        */
+        int getUniformLocation(const std::string& name) const;
+        unsigned getAttribMask() const;
+
+        /**
+            Points the uniform block name at a binding point, kept when the shader is reloaded
+        */
+        Shader& bindUniformBlock(std::string name, unsigned binding);
 
         static void uniform(int loc, float value);
         static void uniform(int loc, int value);
@@ -44,6 +180,28 @@ namespace dgn
         static void uniform(int loc, m3d::mat3x3 value);
         static void uniform(int loc, m3d::mat4x4 value);
 
+        /**
+            Sets a uniform of this shader, which must be bound, unless it already holds the value.
+            Uniforms the program doesn't have are ignored like location -1. Values set through a
+            location bypass the cache, so set each uniform either way but not both.
+        */
+        void uniform(UniformHandle handle, float value);
+        void uniform(UniformHandle handle, int value);
+        void uniform(UniformHandle handle, bool value);
+        void uniform(UniformHandle handle, const m3d::vec2& value);
+        void uniform(UniformHandle handle, const m3d::vec3& value);
+        void uniform(UniformHandle handle, const m3d::vec4& value);
+        void uniform(UniformHandle handle, const m3d::mat3x3& value);
+        void uniform(UniformHandle handle, const m3d::mat4x4& value);
+
         static void setEconst(std::string name, int value);
+
+        /**
+            Linked programs are stored in dir, keyed by their preprocessed sources, the econst values and
+            the driver, and later loads of the same program skip compiling. Binaries the driver no longer
+            accepts are rebuilt from source. An empty dir disables the cache, which is the default.
+        */
+        static void setProgramCacheDir(std::string dir);
+        static ProgramCacheStats getProgramCacheStats();
     };
 }
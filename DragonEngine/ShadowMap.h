@@ -2,10 +2,13 @@
 
 #include "Texture.h"
 #include "Framebuffer.h"
+#include "Frustum.h"
 
 #include <m3d/mat4x4.h>
 #include <m3d/vec3.h>
 
+#include <vector>
+
 namespace dgn
 {
     class Camera;
@@ -27,8 +30,92 @@ namespace dgn
             ShadowMap& updateProjectionMat(const m3d::mat4x4& mat);
             ShadowMap& updateProjectionMatFitted(Camera cam, float near, float far, float near_pull = 0.0f, float scale_value = 1.0f / 1.414314f);
 
-            Framebuffer getFramebuffer();
-            Texture getTexture();
+            const Framebuffer& getFramebuffer() const;
+            const Texture& getTexture() const;
             m3d::mat4x4 getLightMat();
+            /**
+                Volume rendered into the shadow map, casters outside of it can be skipped
+            */
+            Frustum getFrustum() const;
+    };
+
+    /**
+        Every cascade is a layer of one depth 2D array texture, attached as a layered framebuffer, so the
+        casters are submitted once for all cascades. The shadow shader routes each triangle to its cascades
+        with an instanced geometry shader writing gl_Layer, and lit shaders sample the array through a
+        sampler2DArrayShadow at vec4(uv, cascade, depth).
+
+        A layer is only re-rendered when its texel snapped light matrix changed, and at most every
+        update interval frames, so a static sun leaves the far cascades cached. getLightMat returns the
+        matrix the layer was last rendered with, which is the one shaders must sample it with.
+        Casters that move need invalidate(), the matrices alone don't see them.
+    */
+    class CascadedShadowMap
+    {
+        private:
+            struct Cascade
+            {
+                m3d::mat4x4 projection;
+                m3d::mat4x4 rendered_light_mat;
+                // only this layer attached, clearing the layered buffer would clear every cascade
+                Framebuffer layer_buffer;
+                unsigned interval;
+                bool valid;
+            };
+
+            Texture m_texture;
+            Framebuffer m_buffer;
+
+            std::vector<Cascade> m_cascades;
+            m3d::mat4x4 light_view;
+
+            unsigned m_frame;
+            unsigned m_render_mask;
+            unsigned m_skipped;
+        public:
+            CascadedShadowMap();
+
+            CascadedShadowMap& initialize(unsigned width, unsigned height, unsigned cascades);
+            void dispose();
+
+            CascadedShadowMap& updateViewMat(const m3d::vec3& dir);
+            CascadedShadowMap& updateProjectionMatFitted(unsigned cascade, Camera cam, float near, float far, float near_pull = 0.0f, float scale_value = 1.0f / 1.414314f);
+            /**
+                Fits every cascade in one call, cascade i covers distances[i] to distances[i + 1] so distances
+                holds one more value than there are cascades. Gives the same projections as fitting them one
+                by one, but the bounding spheres come straight from the slice shape and nothing is allocated.
+            */
+            CascadedShadowMap& updateProjectionMatsFitted(const Camera& cam, const float *distances, float near_pull = 0.0f, float scale_value = 1.0f / 1.414314f);
+
+            /**
+                The cascade is considered every frames frames, staggered by its index, 1 is every frame
+            */
+            CascadedShadowMap& setUpdateInterval(unsigned cascade, unsigned frames);
+            /**
+                Re-renders every cascade at its next update, call when casters move
+            */
+            CascadedShadowMap& invalidate();
+
+            /**
+                Picks the cascades rendered this frame, call once per frame after fitting them.
+                Returns a bit per cascade, the caller must clear and draw exactly those layers.
+            */
+            unsigned selectCascades();
+            unsigned getRenderMask() const;
+            /**
+                Cascade renders skipped since the last reset
+            */
+            unsigned getSkippedRenders() const;
+            void resetSkippedRenders();
+
+            const Framebuffer& getFramebuffer() const;
+            const Framebuffer& getLayerFramebuffer(unsigned cascade) const;
+            const Texture& getTexture() const;
+            unsigned getCascadeCount() const;
+            m3d::mat4x4 getLightMat(unsigned cascade) const;
+            /**
+                Volume of the fitted projection, which is what the cascade renders if it is selected
+            */
+            Frustum getFrustum(unsigned cascade) const;
     };
 }
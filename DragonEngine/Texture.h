@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace dgn
 {
@@ -47,7 +48,8 @@ namespace dgn
         Texture1D = 0x0DE0,
         Texture2D = 0x0DE1,
         Texture3D = 0x806F,
-        TextureCube = 0x8513
+        TextureCube = 0x8513,
+        Texture2DArray = 0x8C1A
     };
 
     enum class CubemapFace
@@ -106,6 +108,29 @@ namespace dgn
         Texture& loadAs3D(std::string filepath, unsigned depth, TextureWrap wrap, TextureFilter filter,
                                TextureStorage internal_storage, float anisotropy = 0.0f);
 
+        //////////////////////////////////////////////
+        //               2D Array                   //
+        //////////////////////////////////////////////
+
+        /**
+            data holds every layer one after the other and may be nullptr. Mipmaps for filters that use them
+            are generated here, call generateMipmaps again after filling layers with setLayer.
+        */
+        Texture& createAs2DArray(const void *data, TextureData data_type, unsigned width, unsigned height, unsigned layers,
+                                TextureWrap wrap, TextureFilter filter,
+                                TextureStorage internal_storage, TextureStorage given_storage, float anisotropy = 0.0f);
+
+        /**
+            Every file becomes one layer and must be the size of the first
+        */
+        Texture& loadAs2DArray(const std::vector<std::string>& filepaths, TextureWrap wrap, TextureFilter filter,
+                               TextureStorage internal_storage, float anisotropy = -1.0f);
+
+        /**
+            Replaces one layer of a 2D array, binds the texture itself
+        */
+        Texture& setLayer(unsigned layer, const void *data, TextureData data_type, TextureStorage given_storage);
+
         //////////////////////////////////////////////
         //                Cubemap                   //
         //////////////////////////////////////////////
@@ -140,6 +165,10 @@ namespace dgn
         Texture& setFilter(TextureFilter filter);
         Texture& generateMipmaps();
         Texture& setAnisotropy(float anisotropy);
+        /**
+            Depth textures only, lets shaders sample them through shadow samplers
+        */
+        Texture& setDepthCompare(bool enabled);
 
 
         static CubemapFace intToFace(unsigned i);
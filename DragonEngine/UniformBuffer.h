@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+
+namespace m3d
+{
+    class vec2;
+    class vec3;
+    class vec4;
+    class mat3x3;
+    class mat4x4;
+}
+
+namespace dgn
+{
+    /**
+        An array member of a UniformLayout, element(i) is the offset UniformBuffer::set takes for element i
+    */
+    struct UniformArray
+    {
+        unsigned offset;
+        // std140 pads every element to at least 16 bytes
+        unsigned stride;
+        unsigned count;
+
+        unsigned element(unsigned index) const;
+    };
+
+    /**
+        Offsets of a std140 uniform block, members added in the order the block declares them.
+        Scalars align to 4 bytes, vec2 to 8, vec3 and vec4 to 16. Matrices are stored as vec4 columns.
+    */
+    class UniformLayout
+    {
+    private:
+        unsigned m_size;
+
+        unsigned addInternal(unsigned alignment, unsigned size);
+        UniformArray addArrayInternal(unsigned stride, unsigned count);
+
+    public:
+        UniformLayout();
+
+        unsigned addFloat();
+        unsigned addInt();
+        unsigned addVec2();
+        unsigned addVec3();
+        unsigned addVec4();
+        unsigned addMat3();
+        unsigned addMat4();
+
+        UniformArray addFloatArray(unsigned count);
+        UniformArray addIntArray(unsigned count);
+        UniformArray addVec4Array(unsigned count);
+        UniformArray addMat4Array(unsigned count);
+
+        /**
+            Size of the block, rounded up to 16 bytes
+        */
+        unsigned getSize() const;
+    };
+
+    /**
+        A uniform buffer with a cpu copy. Values are written at std140 offsets from a UniformLayout and
+        upload() sends the range changed since the last upload in one call. Bind it with
+        Renderer::bindUniformBuffer to the binding point set with Shader::bindUniformBlock.
+    */
+    class UniformBuffer
+    {
+        friend class Renderer;
+    private:
+        unsigned m_buffer;
+        std::vector<unsigned char> m_data;
+
+        unsigned m_dirty_begin;
+        unsigned m_dirty_end;
+
+        void writeInternal(unsigned offset, const void* data, unsigned size);
+
+    public:
+        UniformBuffer();
+        void dispose();
+
+        UniformBuffer& create(unsigned size);
+        UniformBuffer& create(const UniformLayout& layout);
+
+        UniformBuffer& set(unsigned offset, float value);
+        UniformBuffer& set(unsigned offset, int value);
+        UniformBuffer& set(unsigned offset, const m3d::vec2& value);
+        UniformBuffer& set(unsigned offset, const m3d::vec3& value);
+        UniformBuffer& set(unsigned offset, const m3d::vec4& value);
+        UniformBuffer& set(unsigned offset, const m3d::mat3x3& value);
+        UniformBuffer& set(unsigned offset, const m3d::mat4x4& value);
+
+        void upload();
+
+        unsigned getSize() const;
+    };
+}
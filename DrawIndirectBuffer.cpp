@@ -0,0 +1,127 @@
+#include "DragonEngine/DrawIndirectBuffer.h"
+#include "d_internal.h"
+
+#include <glad/glad.h>
+
+#include <string.h>
+
+namespace dgn
+{
+    DrawIndirectBuffer::DrawIndirectBuffer() : m_command_buffer(0), m_draw_buffer(0), m_max_draws(0), m_draw_stride(0),
+        m_vao(0), m_position_vao(0), m_ibo(0), m_instance_mask(0), m_index_type(IndexType::UnsignedInt), m_uploaded(0) {}
+
+    void DrawIndirectBuffer::dispose()
+    {
+        glCall(glDeleteBuffers(1, &m_command_buffer));
+
+        if(m_draw_buffer)
+        {
+            glCall(glDeleteBuffers(1, &m_draw_buffer));
+        }
+
+        m_command_buffer = 0;
+        m_draw_buffer = 0;
+        m_commands.clear();
+        m_draw_data.clear();
+        m_uploaded = 0;
+    }
+
+    DrawIndirectBuffer& DrawIndirectBuffer::create(unsigned max_draws, unsigned draw_data_stride)
+    {
+        m_max_draws = max_draws;
+        m_draw_stride = draw_data_stride;
+        m_commands.reserve(max_draws);
+        m_draw_data.reserve(max_draws * draw_data_stride);
+
+        if(!GLAD_GL_ARB_multi_draw_indirect && !GLAD_GL_VERSION_4_3)
+        {
+            logError("DRAW INDIRECT", "glMultiDrawElementsIndirect is not supported");
+        }
+
+        glCall(glGenBuffers(1, &m_command_buffer));
+        glCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_command_buffer));
+        glCall(glBufferData(GL_DRAW_INDIRECT_BUFFER, max_draws * sizeof(DrawIndirectCommand), nullptr, GL_DYNAMIC_DRAW));
+        glCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
+
+        if(draw_data_stride > 0)
+        {
+            glCall(glGenBuffers(1, &m_draw_buffer));
+            glCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_draw_buffer));
+            glCall(glBufferData(GL_SHADER_STORAGE_BUFFER, max_draws * draw_data_stride, nullptr, GL_DYNAMIC_DRAW));
+            glCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+        }
+
+        return *this;
+    }
+
+    void DrawIndirectBuffer::clear()
+    {
+        m_commands.clear();
+        m_draw_data.clear();
+        m_uploaded = 0;
+    }
+
+    bool DrawIndirectBuffer::addDraw(const Mesh& mesh, const void* draw_data, unsigned instance_count, unsigned base_instance)
+    {
+        if(m_commands.size() >= m_max_draws) return false;
+
+        if(m_commands.empty())
+        {
+            m_vao = mesh.m_vao;
+            m_position_vao = mesh.m_position_vao;
+            m_ibo = mesh.m_ibo;
+            m_instance_mask = mesh.m_instance_mask;
+            m_index_type = mesh.m_index_type;
+        }
+        else if(mesh.m_vao != m_vao || mesh.m_ibo != m_ibo || mesh.m_index_type != m_index_type)
+        {
+            logError("DRAW INDIRECT", "every mesh in a draw indirect buffer must come from the same mesh arena");
+            return false;
+        }
+
+        m_commands.push_back({mesh.m_length, instance_count, mesh.m_first_index, mesh.m_base_vertex, base_instance});
+
+        if(m_draw_stride > 0)
+        {
+            size_t offset = m_draw_data.size();
+            m_draw_data.resize(offset + m_draw_stride);
+
+            if(draw_data) memcpy(m_draw_data.data() + offset, draw_data, m_draw_stride);
+            else memset(m_draw_data.data() + offset, 0, m_draw_stride);
+        }
+
+        return true;
+    }
+
+    void DrawIndirectBuffer::upload()
+    {
+        unsigned count = m_commands.size();
+        if(count == m_uploaded) return;
+
+        // draws are only ever appended, so only the new ones need to be copied
+        glCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_command_buffer));
+        glCall(glBufferSubData(GL_DRAW_INDIRECT_BUFFER, m_uploaded * sizeof(DrawIndirectCommand),
+                               (count - m_uploaded) * sizeof(DrawIndirectCommand), m_commands.data() + m_uploaded));
+        glCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
+
+        if(m_draw_buffer)
+        {
+            glCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_draw_buffer));
+            glCall(glBufferSubData(GL_SHADER_STORAGE_BUFFER, m_uploaded * m_draw_stride,
+                                   (count - m_uploaded) * m_draw_stride, m_draw_data.data() + m_uploaded * m_draw_stride));
+            glCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+        }
+
+        m_uploaded = count;
+    }
+
+    unsigned DrawIndirectBuffer::getDrawCount() const
+    {
+        return m_commands.size();
+    }
+
+    unsigned DrawIndirectBuffer::getMaxDraws() const
+    {
+        return m_max_draws;
+    }
+}
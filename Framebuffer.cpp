@@ -12,6 +12,7 @@ namespace dgn
     {
         glDeleteFramebuffers(1, &m_buffer);
         glDeleteRenderbuffers(1, &m_rbuffer);
+        invalidateGLStateInternal();
     }
 
     Framebuffer& Framebuffer::create()
@@ -21,6 +22,7 @@ namespace dgn
 
         glCall(glGenRenderbuffers(1, &m_rbuffer));
         glCall(glBindRenderbuffer(GL_RENDERBUFFER, m_rbuffer));
+        invalidateGLStateInternal();
 
         return *this;
     }
@@ -49,6 +51,11 @@ namespace dgn
                 glCall(glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_CUBE_MAP_POSITIVE_X + (unsigned)face, texture.getNativeTexture(), mip));
                 break;
             }
+        case TextureType::Texture2DArray:
+            {
+                glCall(glFramebufferTextureLayer(GL_FRAMEBUFFER, attachment, texture.getNativeTexture(), mip, layer));
+                break;
+            }
         }
 
         return *this;
@@ -84,6 +91,12 @@ namespace dgn
         return setAttachment(texture, texture.getTextureType(), GL_DEPTH_ATTACHMENT, mip, 0, face);
     }
 
+    Framebuffer& Framebuffer::setDepthAttachmentLayered(dgn::Texture texture, unsigned mip)
+    {
+        glCall(glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture.getNativeTexture(), mip));
+        return *this;
+    }
+
     Framebuffer& Framebuffer::createDepthBit(unsigned width, unsigned height)
     {
         glCall(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height));
@@ -130,6 +143,7 @@ namespace dgn
 
         glCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
         glCall(glBindRenderbuffer(GL_RENDERBUFFER, 0));
+        invalidateGLStateInternal();
 
         return *this;
     }
@@ -0,0 +1,205 @@
+#include "DragonEngine/Frustum.h"
+#include "d_internal.h"
+
+#include <cmath>
+
+namespace dgn
+{
+    Frustum::Frustum() : planes() {}
+
+    Frustum Frustum::fromMatrix(const m3d::mat4x4& view_projection)
+    {
+        Frustum res;
+        const float (*m)[4] = view_projection.m;
+
+        // rows of the clip matrix combined as in Gribb and Hartmann
+        for(int i = 0; i < 3; i++)
+        {
+            for(int k = 0; k < 4; k++)
+            {
+                res.planes[i * 2 + 0][k] = m[3][k] + m[i][k];
+                res.planes[i * 2 + 1][k] = m[3][k] - m[i][k];
+            }
+        }
+
+        for(int p = 0; p < 6; p++)
+        {
+            float *plane = res.planes[p];
+            float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            if(length <= 0.0f) continue;
+
+            for(int k = 0; k < 4; k++)
+            {
+                plane[k] /= length;
+            }
+        }
+
+        return res;
+    }
+
+    bool Frustum::testAABB(const m3d::vec3& min, const m3d::vec3& max) const
+    {
+        for(int p = 0; p < 6; p++)
+        {
+            const float *plane = planes[p];
+
+            // corner furthest along the plane normal
+            float x = plane[0] >= 0.0f ? max.x : min.x;
+            float y = plane[1] >= 0.0f ? max.y : min.y;
+            float z = plane[2] >= 0.0f ? max.z : min.z;
+
+            if(plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.0f) return false;
+        }
+
+        return true;
+    }
+
+    bool Frustum::testSphere(const m3d::vec3& center, float radius) const
+    {
+        for(int p = 0; p < 6; p++)
+        {
+            const float *plane = planes[p];
+            if(plane[0] * center.x + plane[1] * center.y + plane[2] * center.z + plane[3] < -radius) return false;
+        }
+
+        return true;
+    }
+
+    ////////////////////////////////////////
+    //            CULLING SET             //
+    ////////////////////////////////////////
+
+    void CullingSet::clear()
+    {
+        m_center_x.clear();
+        m_center_y.clear();
+        m_center_z.clear();
+        m_extent_x.clear();
+        m_extent_y.clear();
+        m_extent_z.clear();
+    }
+
+    unsigned CullingSet::add(const m3d::vec3& min, const m3d::vec3& max)
+    {
+        m_center_x.push_back((min.x + max.x) * 0.5f);
+        m_center_y.push_back((min.y + max.y) * 0.5f);
+        m_center_z.push_back((min.z + max.z) * 0.5f);
+        m_extent_x.push_back((max.x - min.x) * 0.5f);
+        m_extent_y.push_back((max.y - min.y) * 0.5f);
+        m_extent_z.push_back((max.z - min.z) * 0.5f);
+
+        return m_center_x.size() - 1;
+    }
+
+    unsigned CullingSet::add(const MeshBounds& bounds)
+    {
+        return add(bounds.min, bounds.max);
+    }
+
+    unsigned CullingSet::add(const MeshBounds& bounds, const m3d::mat4x4& model)
+    {
+        unsigned index = add(bounds);
+        set(index, bounds, model);
+
+        return index;
+    }
+
+    void CullingSet::set(unsigned index, const MeshBounds& bounds, const m3d::mat4x4& model)
+    {
+        const float (*m)[4] = model.m;
+
+        float c[3] = {(bounds.min.x + bounds.max.x) * 0.5f, (bounds.min.y + bounds.max.y) * 0.5f, (bounds.min.z + bounds.max.z) * 0.5f};
+        float e[3] = {(bounds.max.x - bounds.min.x) * 0.5f, (bounds.max.y - bounds.min.y) * 0.5f, (bounds.max.z - bounds.min.z) * 0.5f};
+
+        float wc[3], we[3];
+        for(int i = 0; i < 3; i++)
+        {
+            wc[i] = m[i][0] * c[0] + m[i][1] * c[1] + m[i][2] * c[2] + m[i][3];
+            we[i] = std::fabs(m[i][0]) * e[0] + std::fabs(m[i][1]) * e[1] + std::fabs(m[i][2]) * e[2];
+        }
+
+        m_center_x[index] = wc[0];
+        m_center_y[index] = wc[1];
+        m_center_z[index] = wc[2];
+        m_extent_x[index] = we[0];
+        m_extent_y[index] = we[1];
+        m_extent_z[index] = we[2];
+    }
+
+    unsigned CullingSet::size() const
+    {
+        return m_center_x.size();
+    }
+
+    // a box is outside a plane when dot(n, center) + d + dot(abs(n), extent) < 0
+    CullStats CullingSet::cull(const Frustum& frustum, std::vector<unsigned>& visible) const
+    {
+        visible.clear();
+        unsigned count = size();
+        unsigned i = 0;
+
+#ifdef DGN_SSE
+        __m128 sign_mask = _mm_set1_ps(-0.0f);
+        __m128 zero = _mm_setzero_ps();
+
+        __m128 n[6][3], an[6][3], d[6];
+        for(int p = 0; p < 6; p++)
+        {
+            for(int k = 0; k < 3; k++)
+            {
+                n[p][k] = _mm_set1_ps(frustum.planes[p][k]);
+                an[p][k] = _mm_andnot_ps(sign_mask, n[p][k]);
+            }
+
+            d[p] = _mm_set1_ps(frustum.planes[p][3]);
+        }
+
+        for(; i + 4 <= count; i += 4)
+        {
+            __m128 cx = _mm_loadu_ps(&m_center_x[i]);
+            __m128 cy = _mm_loadu_ps(&m_center_y[i]);
+            __m128 cz = _mm_loadu_ps(&m_center_z[i]);
+            __m128 ex = _mm_loadu_ps(&m_extent_x[i]);
+            __m128 ey = _mm_loadu_ps(&m_extent_y[i]);
+            __m128 ez = _mm_loadu_ps(&m_extent_z[i]);
+
+            __m128 outside = zero;
+            for(int p = 0; p < 6; p++)
+            {
+                __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[p][0], cx), _mm_mul_ps(n[p][1], cy)),
+                                         _mm_add_ps(_mm_mul_ps(n[p][2], cz), d[p]));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(an[p][0], ex), _mm_mul_ps(an[p][1], ey)), _mm_mul_ps(an[p][2], ez));
+
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, radius), zero));
+            }
+
+            int mask = _mm_movemask_ps(outside);
+            for(unsigned k = 0; k < 4; k++)
+            {
+                if(!(mask & (1 << k))) visible.push_back(i + k);
+            }
+        }
+#endif
+
+        for(; i < count; i++)
+        {
+            bool inside = true;
+            for(int p = 0; p < 6 && inside; p++)
+            {
+                const float *plane = frustum.planes[p];
+                float dist = plane[0] * m_center_x[i] + plane[1] * m_center_y[i] + plane[2] * m_center_z[i] + plane[3];
+                float radius = std::fabs(plane[0]) * m_extent_x[i] + std::fabs(plane[1]) * m_extent_y[i] + std::fabs(plane[2]) * m_extent_z[i];
+
+                inside = dist + radius >= 0.0f;
+            }
+
+            if(inside) visible.push_back(i);
+        }
+
+        CullStats stats;
+        stats.drawn = visible.size();
+        stats.culled = count - stats.drawn;
+
+        return stats;
+    }
+}
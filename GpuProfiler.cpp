@@ -0,0 +1,265 @@
+#include "DragonEngine/GpuProfiler.h"
+#include "d_internal.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <string.h>
+
+namespace dgn
+{
+    GpuProfiler::GpuProfiler() : m_frame(0), m_history(0), m_dropped(0), m_recording(false) {}
+
+    void GpuProfiler::dispose()
+    {
+        for(Frame& frame : m_frames)
+        {
+            if(!frame.queries.empty())
+            {
+                glCall(glDeleteQueries(frame.queries.size(), frame.queries.data()));
+            }
+        }
+
+        m_frames.clear();
+        m_scopes.clear();
+        m_open.clear();
+        m_totals.clear();
+        m_recording = false;
+    }
+
+    GpuProfiler& GpuProfiler::create(unsigned frames_in_flight, unsigned history)
+    {
+        // one more frame than in flight, the oldest is the one being read back
+        m_frames.resize(frames_in_flight + 1);
+        m_history = history;
+        m_frame = 0;
+        m_dropped = 0;
+
+        return *this;
+    }
+
+    unsigned GpuProfiler::queryInternal(Frame& frame)
+    {
+        if(frame.used_queries == frame.queries.size())
+        {
+            unsigned query;
+            glCall(glGenQueries(1, &query));
+            frame.queries.push_back(query);
+        }
+
+        unsigned query = frame.queries[frame.used_queries++];
+        glCall(glQueryCounter(query, GL_TIMESTAMP));
+
+        return query;
+    }
+
+    unsigned GpuProfiler::scopeInternal(const char* name)
+    {
+        for(unsigned i = 0; i < m_scopes.size(); i++)
+        {
+            if(m_scopes[i].name == name) return i;
+        }
+
+        Scope scope;
+        scope.name = name;
+        scope.times.resize(m_history);
+        m_scopes.push_back(scope);
+        m_totals.push_back(0.0);
+
+        return m_scopes.size() - 1;
+    }
+
+    void GpuProfiler::resolveInternal(Frame& frame)
+    {
+        if(frame.samples.empty()) return;
+
+        // queries complete in order, so the last one being ready means all of them are
+        int available = 0;
+        glCall(glGetQueryObjectiv(frame.queries[frame.used_queries - 1], GL_QUERY_RESULT_AVAILABLE, &available));
+
+        if(!available)
+        {
+            m_dropped++;
+            return;
+        }
+
+        std::fill(m_totals.begin(), m_totals.end(), -1.0);
+
+        for(const Sample& sample : frame.samples)
+        {
+            GLuint64 begin = 0, end = 0;
+            glCall(glGetQueryObjectui64v(sample.begin_query, GL_QUERY_RESULT, &begin));
+            glCall(glGetQueryObjectui64v(sample.end_query, GL_QUERY_RESULT, &end));
+
+            // a scope entered several times in a frame counts as their sum
+            double& total = m_totals[sample.scope];
+            total = std::max(total, 0.0) + (end - begin) / 1000000.0;
+        }
+
+        for(unsigned i = 0; i < m_scopes.size(); i++)
+        {
+            if(m_totals[i] < 0.0 || m_history == 0) continue;
+
+            Scope& scope = m_scopes[i];
+            scope.times[scope.next] = m_totals[i];
+            scope.next = (scope.next + 1) % m_history;
+            scope.count = std::min(scope.count + 1, m_history);
+        }
+    }
+
+    void GpuProfiler::beginFrame()
+    {
+        if(m_frames.empty())
+        {
+            logError("GPU PROFILER", "profiler was not created");
+            return;
+        }
+
+        m_frame = (m_frame + 1) % m_frames.size();
+
+        // recorded m_frames.size() - 1 frames ago
+        Frame& frame = m_frames[m_frame];
+        resolveInternal(frame);
+
+        frame.samples.clear();
+        frame.used_queries = 0;
+        m_recording = true;
+    }
+
+    void GpuProfiler::endFrame()
+    {
+        if(!m_open.empty())
+        {
+            logError("GPU PROFILER", "frame ended with open scopes");
+            while(!m_open.empty()) endScope();
+        }
+
+        m_recording = false;
+    }
+
+    void GpuProfiler::beginScope(const char* name)
+    {
+        if(!m_recording) return;
+
+        Frame& frame = m_frames[m_frame];
+
+        Sample sample;
+        sample.scope = scopeInternal(name);
+        sample.begin_query = queryInternal(frame);
+        sample.end_query = 0;
+
+        m_open.push_back(frame.samples.size());
+        frame.samples.push_back(sample);
+    }
+
+    void GpuProfiler::endScope()
+    {
+        if(!m_recording) return;
+
+        if(m_open.empty())
+        {
+            logError("GPU PROFILER", "endScope without beginScope");
+            return;
+        }
+
+        Frame& frame = m_frames[m_frame];
+        frame.samples[m_open.back()].end_query = queryInternal(frame);
+        m_open.pop_back();
+    }
+
+    unsigned GpuProfiler::getScopeCount() const
+    {
+        return m_scopes.size();
+    }
+
+    const char *GpuProfiler::getScopeName(unsigned index) const
+    {
+        return m_scopes[index].name.c_str();
+    }
+
+    GpuTimingStats GpuProfiler::getStats(unsigned index) const
+    {
+        GpuTimingStats res;
+
+        const Scope& scope = m_scopes[index];
+        if(scope.count == 0) return res;
+
+        std::vector<float> sorted(scope.times.begin(), scope.times.begin() + scope.count);
+        std::sort(sorted.begin(), sorted.end());
+
+        double sum = 0.0;
+        for(float t : sorted) sum += t;
+
+        res.samples = scope.count;
+        res.last = scope.times[(scope.next + m_history - 1) % m_history];
+        res.average = sum / scope.count;
+        res.min = sorted.front();
+        res.max = sorted.back();
+        res.p50 = sorted[(scope.count - 1) * 50 / 100];
+        res.p95 = sorted[(scope.count - 1) * 95 / 100];
+        res.p99 = sorted[(scope.count - 1) * 99 / 100];
+
+        return res;
+    }
+
+    GpuTimingStats GpuProfiler::getStats(const char* name) const
+    {
+        for(unsigned i = 0; i < m_scopes.size(); i++)
+        {
+            if(m_scopes[i].name == name) return getStats(i);
+        }
+
+        return GpuTimingStats();
+    }
+
+    unsigned GpuProfiler::getDroppedFrames() const
+    {
+        return m_dropped;
+    }
+
+    bool GpuProfiler::writeCSV(const char* filepath) const
+    {
+        FILE *file = fopen(filepath, "w");
+        if(!file)
+        {
+            logError("GPU PROFILER", (std::string("could not write ") + filepath).c_str());
+            return false;
+        }
+
+        fprintf(file, "scope,samples,last_ms,average_ms,min_ms,max_ms,p50_ms,p95_ms,p99_ms\n");
+        for(unsigned i = 0; i < m_scopes.size(); i++)
+        {
+            GpuTimingStats s = getStats(i);
+            fprintf(file, "%s,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", m_scopes[i].name.c_str(),
+                    s.samples, s.last, s.average, s.min, s.max, s.p50, s.p95, s.p99);
+        }
+
+        fclose(file);
+        return true;
+    }
+
+    bool GpuProfiler::writeJSON(const char* filepath) const
+    {
+        FILE *file = fopen(filepath, "w");
+        if(!file)
+        {
+            logError("GPU PROFILER", (std::string("could not write ") + filepath).c_str());
+            return false;
+        }
+
+        fprintf(file, "{\n  \"dropped_frames\": %u,\n  \"scopes\": [\n", m_dropped);
+        for(unsigned i = 0; i < m_scopes.size(); i++)
+        {
+            GpuTimingStats s = getStats(i);
+            fprintf(file, "    {\"name\": \"");
+            writeEscapedInternal(file, m_scopes[i].name.c_str());
+            fprintf(file, "\", \"samples\": %u, \"last_ms\": %.4f, \"average_ms\": %.4f, \"min_ms\": %.4f, "
+                    "\"max_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f}%s\n",
+                    s.samples, s.last, s.average, s.min, s.max, s.p50, s.p95, s.p99, i + 1 < m_scopes.size() ? "," : "");
+        }
+        fprintf(file, "  ]\n}\n");
+
+        fclose(file);
+        return true;
+    }
+}
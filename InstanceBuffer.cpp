@@ -0,0 +1,166 @@
+#include "DragonEngine/InstanceBuffer.h"
+#include "d_internal.h"
+
+#include <glad/glad.h>
+
+namespace dgn
+{
+    InstanceBuffer::InstanceBuffer() : m_buffer(0), m_mapped(nullptr), m_persistent(false), m_stride(0), m_max_instances(0), m_frames(0),
+        m_region(0), m_count(0), m_offset(0) {}
+
+    void InstanceBuffer::dispose()
+    {
+        for(void *fence : m_fences)
+        {
+            if(fence) glDeleteSync((GLsync)fence);
+        }
+        m_fences.clear();
+
+        if(m_buffer)
+        {
+            if(m_persistent)
+            {
+                glCall(glBindBuffer(GL_ARRAY_BUFFER, m_buffer));
+                glCall(glUnmapBuffer(GL_ARRAY_BUFFER));
+                glCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
+            }
+            glCall(glDeleteBuffers(1, &m_buffer));
+        }
+
+        m_buffer = 0;
+        m_mapped = nullptr;
+        m_persistent = false;
+        m_staging.clear();
+        m_attribs.clear();
+    }
+
+    InstanceBuffer& InstanceBuffer::create(unsigned instance_stride, unsigned max_instances, unsigned frames_in_flight)
+    {
+        m_stride = instance_stride;
+        m_max_instances = max_instances;
+        m_frames = frames_in_flight;
+        m_region = 0;
+        m_count = 0;
+        m_offset = 0;
+        m_persistent = GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+
+        glCall(glGenBuffers(1, &m_buffer));
+        glCall(glBindBuffer(GL_ARRAY_BUFFER, m_buffer));
+
+        if(m_persistent)
+        {
+            m_fences.assign(frames_in_flight, nullptr);
+
+            unsigned size = instance_stride * max_instances * frames_in_flight;
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+            glCall(glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags));
+            glCall(m_mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+        }
+        else
+        {
+            // one region, orphaned on every upload so the driver handles the frames in flight
+            m_frames = 1;
+            m_staging.resize(size_t(instance_stride) * max_instances);
+            m_mapped = m_staging.data();
+
+            glCall(glBufferData(GL_ARRAY_BUFFER, m_staging.size(), nullptr, GL_STREAM_DRAW));
+        }
+
+        glCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+        if(!m_mapped)
+        {
+            logError("INSTANCE BUFFER", "could not map instance buffer");
+        }
+
+        return *this;
+    }
+
+    InstanceBuffer& InstanceBuffer::addInstanceAttrib(unsigned location, int size, AttribType type, bool normalized)
+    {
+        m_attribs.push_back({location, size, type, normalized, false, m_offset});
+        m_offset += attribTypeSize(type, size);
+
+        return *this;
+    }
+
+    InstanceBuffer& InstanceBuffer::addInstanceIntAttrib(unsigned location, int size, AttribType type)
+    {
+        m_attribs.push_back({location, size, type, false, true, m_offset});
+        m_offset += attribTypeSize(type, size);
+
+        return *this;
+    }
+
+    InstanceBuffer& InstanceBuffer::addInstanceMatrix(unsigned location)
+    {
+        for(unsigned i = 0; i < 4; i++)
+        {
+            addInstanceAttrib(location + i, 4);
+        }
+
+        return *this;
+    }
+
+    void* InstanceBuffer::begin()
+    {
+        if(!m_mapped) return nullptr;
+
+        if(!m_persistent)
+        {
+            m_count = 0;
+            return m_mapped;
+        }
+
+        // every draw reading the current region has been issued by now
+        if(m_fences[m_region]) glDeleteSync((GLsync)m_fences[m_region]);
+        m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        m_region = (m_region + 1) % m_frames;
+        m_count = 0;
+
+        GLsync fence = (GLsync)m_fences[m_region];
+        if(fence)
+        {
+            GLenum res = glClientWaitSync(fence, 0, 0);
+            while(res == GL_TIMEOUT_EXPIRED)
+            {
+                res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            }
+
+            glDeleteSync(fence);
+            m_fences[m_region] = nullptr;
+        }
+
+        return m_mapped + size_t(m_region) * m_max_instances * m_stride;
+    }
+
+    void InstanceBuffer::end(unsigned count)
+    {
+        m_count = count < m_max_instances ? count : m_max_instances;
+
+        if(!m_persistent && m_buffer)
+        {
+            glCall(glBindBuffer(GL_ARRAY_BUFFER, m_buffer));
+            glCall(glBufferData(GL_ARRAY_BUFFER, m_staging.size(), nullptr, GL_STREAM_DRAW));
+            glCall(glBufferSubData(GL_ARRAY_BUFFER, 0, size_t(m_count) * m_stride, m_staging.data()));
+            glCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        }
+    }
+
+    unsigned InstanceBuffer::getCount() const
+    {
+        return m_count;
+    }
+
+    unsigned InstanceBuffer::getBaseInstance() const
+    {
+        return m_region * m_max_instances;
+    }
+
+    unsigned InstanceBuffer::getMaxInstances() const
+    {
+        return m_max_instances;
+    }
+}
@@ -0,0 +1,157 @@
+#include "DragonEngine/MaterialArray.h"
+#include "DragonEngine/Profiler.h"
+#include "d_internal.h"
+
+#include "lodepng.h"
+
+#include <glad/glad.h>
+#include <vector>
+
+namespace dgn
+{
+    // value of a layer with no map, rgba
+    static const unsigned char NEUTRAL_VALUES[MaterialArray::MAP_COUNT][4] =
+    {
+        {255, 255, 255, 255},
+        {255, 255, 255, 255},
+        {  0,   0,   0, 255},
+        {128, 128, 255, 255},
+        {255, 255, 255, 255}
+    };
+
+    // the color map holds srgb values, the others linear data
+    static const TextureStorage MAP_STORAGE[MaterialArray::MAP_COUNT] =
+    {
+        TextureStorage::SRGBA,
+        TextureStorage::RGBA,
+        TextureStorage::RGBA,
+        TextureStorage::RGBA,
+        TextureStorage::RGBA
+    };
+
+    MaterialArray::MaterialArray() : m_width(0), m_height(0), m_count(0), m_max_materials(0), m_anisotropy(0) {}
+
+    void MaterialArray::dispose()
+    {
+        for(unsigned i = 0; i < MAP_COUNT; i++)
+        {
+            m_maps[i].dispose();
+        }
+
+        m_count = 0;
+    }
+
+    MaterialArray& MaterialArray::create(unsigned width, unsigned height, unsigned max_materials, float anisotropy)
+    {
+        m_width = width;
+        m_height = height;
+        m_count = 0;
+        m_max_materials = max_materials;
+        m_anisotropy = anisotropy;
+
+        // mipmaps are built once every layer is filled, in complete
+        for(unsigned i = 0; i < MAP_COUNT; i++)
+        {
+            m_maps[i].createAs2DArray(nullptr, TextureData::Ubyte, width, height, max_materials,
+                                      TextureWrap::Repeat, TextureFilter::Bilinear, MAP_STORAGE[i], TextureStorage::RGBA);
+        }
+
+        return *this;
+    }
+
+    void MaterialArray::fillInternal(unsigned map, unsigned layer, const unsigned char value[4])
+    {
+        std::vector<unsigned char> pixels(m_width * m_height * 4);
+        for(size_t p = 0; p < pixels.size(); p += 4)
+        {
+            for(unsigned c = 0; c < 4; c++)
+            {
+                pixels[p + c] = value[c];
+            }
+        }
+
+        m_maps[map].setLayer(layer, pixels.data(), TextureData::Ubyte, TextureStorage::RGBA);
+    }
+
+    unsigned MaterialArray::addMaterial(const std::string filepaths[MAP_COUNT])
+    {
+        DGN_PROFILE_SCOPE("MaterialLoad");
+
+        if(m_count >= m_max_materials)
+        {
+            logError("MATERIAL ARRAY", "no free layers left");
+            return INVALID_MATERIAL;
+        }
+
+        unsigned layer = m_count++;
+
+        for(unsigned i = 0; i < MAP_COUNT; i++)
+        {
+            if(filepaths[i].empty())
+            {
+                fillInternal(i, layer, NEUTRAL_VALUES[i]);
+                continue;
+            }
+
+            std::vector<unsigned char> pixels;
+            unsigned width, height;
+
+            unsigned error = lodepng::decode(pixels, width, height, filepaths[i]);
+            if(error)
+            {
+                std::string s = lodepng_error_text(error);
+                s += "\n\tFile" + filepaths[i];
+                logError("PNG LOADING", s.c_str());
+
+                fillInternal(i, layer, NEUTRAL_VALUES[i]);
+                continue;
+            }
+
+            // a single pixel image, like white.png, fills the whole layer with its value
+            if(width == 1 && height == 1)
+            {
+                fillInternal(i, layer, pixels.data());
+                continue;
+            }
+
+            if(width != m_width || height != m_height)
+            {
+                logError("MATERIAL MAP SIZE", filepaths[i].c_str());
+
+                fillInternal(i, layer, NEUTRAL_VALUES[i]);
+                continue;
+            }
+
+            m_maps[i].setLayer(layer, pixels.data(), TextureData::Ubyte, TextureStorage::RGBA);
+        }
+
+        return layer;
+    }
+
+    MaterialArray& MaterialArray::complete()
+    {
+        for(unsigned i = 0; i < MAP_COUNT; i++)
+        {
+            // setFilter and friends work on the texture bound in slot 0
+            glCall(glActiveTexture(GL_TEXTURE0));
+            glCall(glBindTexture(GL_TEXTURE_2D_ARRAY, m_maps[i].getNativeTexture()));
+
+            m_maps[i].setFilter(TextureFilter::Trilinear).generateMipmaps().setAnisotropy(m_anisotropy);
+        }
+
+        glCall(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+        invalidateGLStateInternal();
+
+        return *this;
+    }
+
+    const Texture& MaterialArray::getMap(MaterialMap map) const
+    {
+        return m_maps[(unsigned)map];
+    }
+
+    unsigned MaterialArray::getMaterialCount() const
+    {
+        return m_count;
+    }
+}
@@ -1,4 +1,8 @@
 #include "DragonEngine/Mesh.h"
+#include "DragonEngine/InstanceBuffer.h"
+#include "DragonEngine/MeshArena.h"
+#include "DragonEngine/MeshOptimizer.h"
+#include "DragonEngine/Profiler.h"
 #include "d_internal.h"
 
 #include <assimp/Importer.hpp>
@@ -9,9 +13,15 @@
 
 #include <m3d/vec3.h>
 
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+
 namespace dgn
 {
-    Mesh::Mesh() : m_vao(0), m_vbo(0), m_ibo(0), m_length(0), vert_size(0), vert_offsets(0)
+    Mesh::Mesh() : m_vao(0), m_vbo(0), m_ibo(0), m_position_vao(0), m_position_vbo(0), m_length(0), m_index_type(IndexType::UnsignedInt),
+        m_first_index(0), m_base_vertex(0), m_arena_allocated(false), m_instance_mask(0), vert_size(0), vert_offsets(0)
     {}
 
     Mesh::~Mesh()
@@ -22,31 +32,66 @@ namespace dgn
     {
         if(m_disposed) return;
 
+        // the arena owns the buffers
+        if(m_arena_allocated)
+        {
+            m_length = 0;
+            m_disposed = true;
+            return;
+        }
+
         glCall(glDeleteVertexArrays(1, &m_vao));
         glCall(glDeleteBuffers(1, &m_vbo));
         glCall(glDeleteBuffers(1, &m_ibo));
+
+        if(m_position_vao)
+        {
+            glCall(glDeleteVertexArrays(1, &m_position_vao));
+            glCall(glDeleteBuffers(1, &m_position_vbo));
+            m_position_vao = 0;
+            m_position_vbo = 0;
+        }
+
+        invalidateGLStateInternal();
         m_length = 0;
         m_disposed = true;
     }
 
+    unsigned indexTypeSize(IndexType type)
+    {
+        return type == IndexType::UnsignedShort ? sizeof(uint16_t) : sizeof(uint32_t);
+    }
+
     Mesh& Mesh::createFromData(const std::vector<float>& vertex_data, const std::vector<unsigned>& index_data)
+    {
+        return createFromData(vertex_data.data(), vertex_data.size() * sizeof(float), index_data.data(), index_data.size(), IndexType::UnsignedInt);
+    }
+
+    Mesh& Mesh::createFromData(const std::vector<float>& vertex_data, const std::vector<uint16_t>& index_data)
+    {
+        return createFromData(vertex_data.data(), vertex_data.size() * sizeof(float), index_data.data(), index_data.size(), IndexType::UnsignedShort);
+    }
+
+    Mesh& Mesh::createFromData(const void* vertex_data, unsigned vertex_bytes, const void* index_data, unsigned index_count, IndexType index_type)
     {
         glCall(glGenVertexArrays(1, &m_vao));
         glCall(glGenBuffers(1, &m_vbo));
         glCall(glGenBuffers(1, &m_ibo));
 
         glCall(glBindVertexArray(m_vao));
+        invalidateGLStateInternal();
 
         // -------- Index Data
         glCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo));
-        glCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_data.size() * sizeof(unsigned), index_data.data(), GL_STATIC_DRAW));
+        glCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * indexTypeSize(index_type), index_data, GL_STATIC_DRAW));
         glCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
 
         // -------- Vertex Data
         glCall(glBindBuffer(GL_ARRAY_BUFFER, m_vbo));
-        glCall(glBufferData(GL_ARRAY_BUFFER, vertex_data.size() * sizeof(float), vertex_data.data(), GL_STATIC_DRAW));
+        glCall(glBufferData(GL_ARRAY_BUFFER, vertex_bytes, vertex_data, GL_STATIC_DRAW));
 
-        m_length = index_data.size();
+        m_length = index_count;
+        m_index_type = index_type;
 
         return *this;
     }
@@ -58,6 +103,7 @@ namespace dgn
         glCall(glGenBuffers(1, &m_ibo));
 
         glCall(glBindVertexArray(m_vao));
+        invalidateGLStateInternal();
 
         // -------- Index Data
         glCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo));
@@ -69,6 +115,7 @@ namespace dgn
         glCall(glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STATIC_DRAW));
 
         m_length = index_data.size();
+        m_index_type = IndexType::UnsignedInt;
 
         return *this;
     }
@@ -79,12 +126,38 @@ namespace dgn
         return *this;
     }
 
-    Mesh& Mesh::addVertexAttrib(unsigned location, int size)
+    Mesh& Mesh::setVertexStride(unsigned bytes)
+    {
+        vert_size = bytes;
+        return *this;
+    }
+
+    unsigned attribTypeSize(AttribType type, int size)
     {
-        glCall(glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, vert_size, (void*)vert_offsets));
+        switch(type)
+        {
+        case AttribType::Byte:
+        case AttribType::UnsignedByte:
+            return size;
+        case AttribType::Short:
+        case AttribType::UnsignedShort:
+        case AttribType::HalfFloat:
+            return size * 2;
+        case AttribType::Int2_10_10_10:
+        case AttribType::UnsignedInt2_10_10_10:
+            return 4;
+        case AttribType::Float:
+        default:
+            return size * 4;
+        }
+    }
+
+    Mesh& Mesh::addVertexAttrib(unsigned location, int size, AttribType type, bool normalized)
+    {
+        glCall(glVertexAttribPointer(location, size, int(type), normalized ? GL_TRUE : GL_FALSE, vert_size, (void*)(uintptr_t)vert_offsets));
         glCall(glEnableVertexAttribArray(location));
 
-        vert_offsets += size * sizeof(float);
+        vert_offsets += attribTypeSize(type, size);
 
         return *this;
     }
@@ -93,21 +166,468 @@ namespace dgn
     {
         glCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
         glCall(glBindVertexArray(0));
+        invalidateGLStateInternal();
 
         m_disposed = false;
 
         return *this;
     }
 
+    Mesh& Mesh::createPositionStream(const void* position_data, unsigned position_bytes, int size, AttribType type, bool normalized)
+    {
+        glCall(glGenVertexArrays(1, &m_position_vao));
+        glCall(glGenBuffers(1, &m_position_vbo));
+
+        glCall(glBindVertexArray(m_position_vao));
+        invalidateGLStateInternal();
+
+        glCall(glBindBuffer(GL_ARRAY_BUFFER, m_position_vbo));
+        glCall(glBufferData(GL_ARRAY_BUFFER, position_bytes, position_data, GL_STATIC_DRAW));
+
+        glCall(glVertexAttribPointer(0, size, int(type), normalized ? GL_TRUE : GL_FALSE, 0, nullptr));
+        glCall(glEnableVertexAttribArray(0));
+
+        glCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        glCall(glBindVertexArray(0));
+        invalidateGLStateInternal();
+
+        return *this;
+    }
+
+    Mesh& Mesh::addInstanceStream(const InstanceBuffer& instances)
+    {
+        unsigned vaos[2] = {m_vao, m_position_vao};
+
+        for(unsigned vao : vaos)
+        {
+            if(vao == 0) continue;
+
+            glCall(glBindVertexArray(vao));
+            invalidateGLStateInternal();
+            glCall(glBindBuffer(GL_ARRAY_BUFFER, instances.m_buffer));
+
+            for(const InstanceBuffer::Attrib& a : instances.m_attribs)
+            {
+                if(a.integer)
+                {
+                    glCall(glVertexAttribIPointer(a.location, a.size, int(a.type), instances.m_stride, (void*)(uintptr_t)a.offset));
+                }
+                else
+                {
+                    glCall(glVertexAttribPointer(a.location, a.size, int(a.type), a.normalized ? GL_TRUE : GL_FALSE,
+                                                 instances.m_stride, (void*)(uintptr_t)a.offset));
+                }
+
+                glCall(glVertexAttribDivisor(a.location, 1));
+                glCall(glEnableVertexAttribArray(a.location));
+            }
+        }
+
+        for(const InstanceBuffer::Attrib& a : instances.m_attribs)
+        {
+            m_instance_mask |= 1u << a.location;
+        }
+
+        glCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        glCall(glBindVertexArray(0));
+        invalidateGLStateInternal();
+
+        return *this;
+    }
+
+    bool Mesh::hasPositionStream() const
+    {
+        return m_position_vao != 0;
+    }
+
+    bool Mesh::isArenaAllocated() const
+    {
+        return m_arena_allocated;
+    }
+
+    IndexType Mesh::getIndexType() const
+    {
+        return m_index_type;
+    }
+
+    Mesh& Mesh::setBounds(const MeshBounds& bounds)
+    {
+        m_bounds = bounds;
+        return *this;
+    }
+
+    const MeshBounds& Mesh::getBounds() const
+    {
+        return m_bounds;
+    }
+
+    MeshBounds Mesh::computeBounds(const float* positions, unsigned vertex_count, unsigned stride)
+    {
+        MeshBounds res;
+        if(vertex_count == 0) return res;
+
+        float lo[4], hi[4], c[4];
+        float radius_sq = 0.0f;
+
+#ifdef DGN_SSE
+        // each position is read as 4 floats, the last one separately so nothing past the end is touched
+        const float *last = positions + size_t(vertex_count - 1) * stride;
+        __m128 last_p = _mm_set_ps(0.0f, last[2], last[1], last[0]);
+
+        __m128 vmin = last_p;
+        __m128 vmax = last_p;
+        for(unsigned v = 0; v + 1 < vertex_count; v++)
+        {
+            __m128 p = _mm_loadu_ps(positions + size_t(v) * stride);
+            vmin = _mm_min_ps(vmin, p);
+            vmax = _mm_max_ps(vmax, p);
+        }
+
+        __m128 vc = _mm_mul_ps(_mm_add_ps(vmin, vmax), _mm_set1_ps(0.5f));
+
+        __m128 vradius = _mm_setzero_ps();
+        for(unsigned v = 0; v < vertex_count; v++)
+        {
+            __m128 p = v + 1 < vertex_count ? _mm_loadu_ps(positions + size_t(v) * stride) : last_p;
+            __m128 d = _mm_sub_ps(p, vc);
+            d = _mm_mul_ps(d, d);
+
+            // x + y + z in the lowest lane
+            __m128 sum = _mm_add_ss(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 1, 1, 1)));
+            sum = _mm_add_ss(sum, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 2, 2, 2)));
+            vradius = _mm_max_ss(vradius, sum);
+        }
+
+        _mm_storeu_ps(lo, vmin);
+        _mm_storeu_ps(hi, vmax);
+        _mm_storeu_ps(c, vc);
+        _mm_store_ss(&radius_sq, vradius);
+#else
+        for(int k = 0; k < 3; k++)
+        {
+            lo[k] = hi[k] = positions[k];
+        }
+
+        for(unsigned v = 1; v < vertex_count; v++)
+        {
+            const float *p = positions + size_t(v) * stride;
+            for(int k = 0; k < 3; k++)
+            {
+                lo[k] = std::min(lo[k], p[k]);
+                hi[k] = std::max(hi[k], p[k]);
+            }
+        }
+
+        for(int k = 0; k < 3; k++)
+        {
+            c[k] = (lo[k] + hi[k]) * 0.5f;
+        }
+
+        for(unsigned v = 0; v < vertex_count; v++)
+        {
+            const float *p = positions + size_t(v) * stride;
+            float dx = p[0] - c[0], dy = p[1] - c[1], dz = p[2] - c[2];
+            radius_sq = std::max(radius_sq, dx * dx + dy * dy + dz * dz);
+        }
+#endif
+
+        res.min = m3d::vec3(lo[0], lo[1], lo[2]);
+        res.max = m3d::vec3(hi[0], hi[1], hi[2]);
+        res.center = m3d::vec3(c[0], c[1], c[2]);
+        res.radius = std::sqrt(radius_sq);
+
+        return res;
+    }
+
+    MeshBounds modelBounds(const Model& model)
+    {
+        MeshBounds res;
+        if(model.empty()) return res;
+
+        res.min = model[0].getBounds().min;
+        res.max = model[0].getBounds().max;
+
+        for(const Mesh& m : model)
+        {
+            const MeshBounds& b = m.getBounds();
+            res.min = m3d::vec3(std::min(res.min.x, b.min.x), std::min(res.min.y, b.min.y), std::min(res.min.z, b.min.z));
+            res.max = m3d::vec3(std::max(res.max.x, b.max.x), std::max(res.max.y, b.max.y), std::max(res.max.z, b.max.z));
+        }
+
+        res.center = (res.min + res.max) * 0.5f;
+
+        for(const Mesh& m : model)
+        {
+            const MeshBounds& b = m.getBounds();
+            res.radius = std::max(res.radius, m3d::vec3::distance(res.center, b.center) + b.radius);
+        }
+
+        return res;
+    }
+
     ////////////////////////////////////////
     //          MODEL LOADING             //
     ////////////////////////////////////////
 
-    Mesh aiMeshConvert(struct aiMesh* mesh);
-    std::vector<Mesh> Mesh::loadFromFile(std::string filepath)
+    struct CookedAttrib
+    {
+        // component count, 0 if the attribute is not present
+        uint32_t size;
+        uint32_t type;
+        uint32_t normalized;
+    };
+
+    // Everything needed to upload a cooked mesh, stored as is in the mesh cache
+    struct CookedLayout
+    {
+        uint32_t vertex_stride;
+        CookedAttrib attribs[4];
+        uint32_t vertex_bytes;
+        uint32_t index_count;
+        uint32_t index_type;
+        // size of the separate position stream, 0 if there is none
+        uint32_t position_bytes;
+        // local bounds
+        float bounds_min[3];
+        float bounds_max[3];
+        float sphere_center[3];
+        float sphere_radius;
+    };
+
+    // Mesh data in the exact layout it is uploaded with
+    struct CookedMesh
+    {
+        CookedLayout layout = {};
+        std::vector<unsigned char> vertices;
+        std::vector<unsigned char> indices;
+        std::vector<unsigned char> positions;
+    };
+
+    /*
+        Mesh cache file layout:
+            MeshCacheHeader
+            for each mesh: CookedLayout, vertex blob, index blob padded to 4 bytes, position blob
+    */
+    const uint32_t MESH_CACHE_MAGIC   = 0x434D4744; // "DGMC"
+    const uint32_t MESH_CACHE_VERSION = 7;
+
+    const uint32_t MESH_CACHE_OPTIMIZED       = 1 << 0;
+    const uint32_t MESH_CACHE_POSITION_STREAM = 1 << 2;
+
+    struct MeshCacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        int64_t  source_time;
+        uint64_t source_size;
+        uint32_t mesh_count;
+        uint32_t flags;
+    };
+
+    void aiMeshConvert(const struct aiMesh* mesh, CookedMesh& cooked, const MeshImportSettings& settings, MeshOptimizeStats* stats = nullptr);
+
+    static unsigned indexBlobSize(unsigned index_count, IndexType index_type)
+    {
+        return (index_count * indexTypeSize(index_type) + 3) & ~3u;
+    }
+
+    static bool arenaMatchesLayout(const MeshArena& arena, const CookedLayout& layout)
+    {
+        if(arena.getVertexStride() != layout.vertex_stride) return false;
+
+        unsigned count = 0;
+        for(unsigned i = 0; i < 4; i++)
+        {
+            const CookedAttrib& a = layout.attribs[i];
+            if(a.size == 0) continue;
+
+            if(!arena.hasVertexAttrib(i, a.size, AttribType(a.type), a.normalized)) return false;
+            count++;
+        }
+
+        return count == arena.getVertexAttribCount();
+    }
+
+    static MeshBounds layoutBounds(const CookedLayout& layout)
+    {
+        MeshBounds b;
+        b.min = m3d::vec3(layout.bounds_min[0], layout.bounds_min[1], layout.bounds_min[2]);
+        b.max = m3d::vec3(layout.bounds_max[0], layout.bounds_max[1], layout.bounds_max[2]);
+        b.center = m3d::vec3(layout.sphere_center[0], layout.sphere_center[1], layout.sphere_center[2]);
+        b.radius = layout.sphere_radius;
+        return b;
+    }
+
+    static Mesh uploadMesh(const CookedLayout& layout, const unsigned char* vertices, const unsigned char* indices, const unsigned char* positions,
+                           MeshArena* arena)
     {
+        if(arena && layout.vertex_stride && arenaMatchesLayout(*arena, layout))
+        {
+            Mesh m;
+            if(arena->allocate(m, vertices, layout.vertex_bytes / layout.vertex_stride, indices, layout.index_count,
+                               IndexType(layout.index_type), layout.position_bytes ? positions : nullptr))
+            {
+                m.setBounds(layoutBounds(layout));
+                return m;
+            }
+        }
+
+        Mesh m = Mesh().createFromData(vertices, layout.vertex_bytes, indices, layout.index_count, IndexType(layout.index_type));
+        m.setVertexStride(layout.vertex_stride);
+
+        for(int i = 0; i < 4; i++)
+        {
+            const CookedAttrib& a = layout.attribs[i];
+            if(a.size)
+                m.addVertexAttrib(i, a.size, AttribType(a.type), a.normalized);
+        }
+
+        m.complete();
+
+        if(layout.position_bytes)
+        {
+            const CookedAttrib& a = layout.attribs[0];
+            m.createPositionStream(positions, layout.position_bytes, a.size, AttribType(a.type), a.normalized);
+        }
+
+        m.setBounds(layoutBounds(layout));
+        return m;
+    }
+
+    static Mesh uploadMesh(const CookedMesh& c, MeshArena* arena)
+    {
+        return uploadMesh(c.layout, c.vertices.data(), c.indices.data(), c.positions.data(), arena);
+    }
+
+    static size_t cookedBlobSize(const CookedLayout& layout)
+    {
+        return size_t(layout.vertex_bytes) + indexBlobSize(layout.index_count, IndexType(layout.index_type)) + layout.position_bytes;
+    }
+
+    static bool readMeshCache(const std::string& cache_path, int64_t source_time, uint64_t source_size, uint32_t flags,
+                              MeshArena* arena, std::vector<Mesh>& res)
+    {
+        MappedFileInternal file;
+        if(!mapFileInternal(cache_path.c_str(), file)) return false;
+
+        const unsigned char *p = file.data;
+        const unsigned char *end = file.data + file.size;
+
+        MeshCacheHeader header;
+        if(file.size < sizeof(header))
+        {
+            unmapFileInternal(file);
+            return false;
+        }
+        memcpy(&header, p, sizeof(header));
+        p += sizeof(header);
+
+        if(header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION ||
+           header.source_time != source_time || header.source_size != source_size || header.flags != flags)
+        {
+            unmapFileInternal(file);
+            return false;
+        }
+
+        // validate the whole file before creating any gl objects
+        std::vector<const unsigned char*> entries;
+        for(uint32_t i = 0; i < header.mesh_count; i++)
+        {
+            CookedLayout layout;
+            if(size_t(end - p) < sizeof(layout)) break;
+            memcpy(&layout, p, sizeof(layout));
+
+            if(layout.index_type != unsigned(IndexType::UnsignedShort) && layout.index_type != unsigned(IndexType::UnsignedInt)) break;
+            if(layout.vertex_bytes % 4 != 0 || layout.position_bytes % 4 != 0) break;
+
+            size_t blob_size = cookedBlobSize(layout);
+            if(size_t(end - p) - sizeof(layout) < blob_size) break;
+
+            entries.push_back(p);
+            p += sizeof(layout) + blob_size;
+        }
+
+        if(entries.size() != header.mesh_count)
+        {
+            logError("MESH CACHE CORRUPT", cache_path.c_str());
+            unmapFileInternal(file);
+            return false;
+        }
+
+        for(const unsigned char *e : entries)
+        {
+            CookedLayout layout;
+            memcpy(&layout, e, sizeof(layout));
+
+            const unsigned char *vertices = e + sizeof(layout);
+            const unsigned char *indices = vertices + layout.vertex_bytes;
+            const unsigned char *positions = indices + indexBlobSize(layout.index_count, IndexType(layout.index_type));
+
+            res.push_back(uploadMesh(layout, vertices, indices, positions, arena));
+        }
+
+        unmapFileInternal(file);
+        return true;
+    }
+
+    static void writeMeshCache(const std::string& cache_path, int64_t source_time, uint64_t source_size, uint32_t flags, const std::vector<CookedMesh>& meshes)
+    {
+        // write to a temporary file first so a failed write never leaves a valid looking cache
+        std::string temp_path = cache_path + ".tmp";
+        FILE *file = fopen(temp_path.c_str(), "wb");
+        if(!file)
+        {
+            logError("MESH CACHE WRITING", cache_path.c_str());
+            return;
+        }
+
+        MeshCacheHeader header = {};
+        header.magic = MESH_CACHE_MAGIC;
+        header.version = MESH_CACHE_VERSION;
+        header.source_time = source_time;
+        header.source_size = source_size;
+        header.mesh_count = meshes.size();
+        header.flags = flags;
+
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+        for(const CookedMesh& m : meshes)
+        {
+            ok = ok && fwrite(&m.layout, sizeof(m.layout), 1, file) == 1;
+            ok = ok && fwrite(m.vertices.data(), 1, m.vertices.size(), file) == m.vertices.size();
+            ok = ok && fwrite(m.indices.data(), 1, m.indices.size(), file) == m.indices.size();
+            ok = ok && fwrite(m.positions.data(), 1, m.positions.size(), file) == m.positions.size();
+        }
+
+        ok = (fclose(file) == 0) && ok;
+
+        remove(cache_path.c_str());
+        if(!ok || rename(temp_path.c_str(), cache_path.c_str()) != 0)
+        {
+            remove(temp_path.c_str());
+            logError("MESH CACHE WRITING", cache_path.c_str());
+        }
+    }
+
+    std::vector<Mesh> Mesh::loadFromFile(std::string filepath, MeshImportSettings settings)
+    {
+        DGN_PROFILE_SCOPE("MeshLoad");
+
         std::vector<Mesh> res;
 
+        std::string cache_path = filepath + ".dmesh";
+        int64_t source_time = 0;
+        uint64_t source_size = 0;
+        uint32_t flags = (settings.optimize ? MESH_CACHE_OPTIMIZED : 0) |
+                         (settings.position_stream ? MESH_CACHE_POSITION_STREAM : 0);
+
+        bool use_cache = settings.use_cache && fileStatInternal(filepath.c_str(), source_time, source_size);
+
+        if(use_cache && readMeshCache(cache_path, source_time, source_size, flags, settings.arena, res))
+        {
+            return res;
+        }
+
         Assimp::Importer importer;
 
         const aiScene* scene = importer.ReadFile(filepath.c_str(), aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices | aiProcess_CalcTangentSpace);
@@ -118,101 +638,235 @@ namespace dgn
             return res;
         }
 
+        std::vector<CookedMesh> cooked(scene->mNumMeshes);
+
         // Now we can access the file's contents
         for(unsigned i = 0; i < scene->mNumMeshes; i++)
         {
-            res.push_back(aiMeshConvert(scene->mMeshes[i]));
+            aiMeshConvert(scene->mMeshes[i], cooked[i], settings);
+            res.push_back(uploadMesh(cooked[i], settings.arena));
         }
 
         // We're done. Release all resources associated with this import
         importer.FreeScene();
+
+        if(use_cache)
+        {
+            writeMeshCache(cache_path, source_time, source_size, flags, cooked);
+        }
+
         return res;
     }
 
-    Mesh aiMeshConvert(struct aiMesh* mesh)
+    std::vector<MeshOptimizeStats> Mesh::loadOptimizeStats(std::string filepath)
+    {
+        std::vector<MeshOptimizeStats> res;
+
+        Assimp::Importer importer;
+
+        const aiScene* scene = importer.ReadFile(filepath.c_str(), aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices | aiProcess_CalcTangentSpace);
+        // If the import failed, report it
+        if(!scene)
+        {
+            logError("MESH LOADING", importer.GetErrorString());
+            return res;
+        }
+
+        MeshImportSettings settings;
+        settings.use_cache = false;
+        settings.optimize = true;
+
+        res.resize(scene->mNumMeshes);
+        for(unsigned i = 0; i < scene->mNumMeshes; i++)
+        {
+            CookedMesh cooked;
+            aiMeshConvert(scene->mMeshes[i], cooked, settings, &res[i]);
+        }
+
+        importer.FreeScene();
+        return res;
+    }
+
+    static void extractPositions(unsigned vertex_count, CookedMesh& cooked)
+    {
+        const CookedAttrib& a = cooked.layout.attribs[0];
+        if(a.size == 0 || vertex_count == 0) return;
+
+        unsigned position_size = attribTypeSize(AttribType(a.type), a.size);
+        unsigned stride = cooked.layout.vertex_stride;
+
+        cooked.layout.position_bytes = vertex_count * position_size;
+        cooked.positions.resize(cooked.layout.position_bytes);
+
+        for(unsigned v = 0; v < vertex_count; v++)
+        {
+            memcpy(&cooked.positions[size_t(v) * position_size], &cooked.vertices[size_t(v) * stride], position_size);
+        }
+    }
+
+    // 16 bit indices whenever every vertex can be addressed with them
+    static void packIndices(const std::vector<unsigned>& indices, unsigned vertex_count, CookedMesh& cooked)
     {
-        unsigned char single_vertex_size = 0;
-        bool attributes[4];
+        cooked.layout.index_count = indices.size();
+        IndexType index_type = vertex_count <= 65536 ? IndexType::UnsignedShort : IndexType::UnsignedInt;
+        cooked.layout.index_type = unsigned(index_type);
+        cooked.indices.assign(indexBlobSize(cooked.layout.index_count, index_type), 0);
+
+        if(index_type == IndexType::UnsignedShort)
+        {
+            uint16_t *out = (uint16_t*)cooked.indices.data();
+            for(unsigned i = 0; i < indices.size(); i++)
+            {
+                out[i] = uint16_t(indices[i]);
+            }
+        }
+        else
+        {
+            memcpy(cooked.indices.data(), indices.data(), indices.size() * sizeof(unsigned));
+        }
+    }
+
+    void aiMeshConvert(const struct aiMesh* mesh, CookedMesh& cooked, const MeshImportSettings& settings, MeshOptimizeStats* stats)
+    {
+        unsigned single_vertex_size = 0;
+        bool attributes[4] = {false, false, false, false};
         unsigned sizes[4] = {3, 2, 3, 3};
+        unsigned offsets[4] = {0, 0, 0, 0};
         if(mesh->mVertices)
         {
+            offsets[0] = single_vertex_size;
             single_vertex_size += 3;
             attributes[0] = true;
         }
 
         if(mesh->mTextureCoords[0])
         {
+            offsets[1] = single_vertex_size;
             single_vertex_size += 2;
             attributes[1] = true;
         }
 
         if(mesh->mNormals)
         {
+            offsets[2] = single_vertex_size;
             single_vertex_size += 3;
             attributes[2] = true;
         }
 
         if(mesh->mTangents)
         {
+            offsets[3] = single_vertex_size;
             single_vertex_size += 3;
             attributes[3] = true;
         }
 
-
         std::vector<float> vertices;
         std::vector<unsigned> indices;
 
+        vertices.resize(size_t(mesh->mNumVertices) * single_vertex_size);
+        float *v_out = vertices.data();
+
         for(uint32_t v = 0; v < mesh->mNumVertices; v++)
         {
             if(attributes[0])
             {
-                vertices.push_back(mesh->mVertices[v].x);
-                vertices.push_back(mesh->mVertices[v].y);
-                vertices.push_back(mesh->mVertices[v].z);
+                *v_out++ = mesh->mVertices[v].x;
+                *v_out++ = mesh->mVertices[v].y;
+                *v_out++ = mesh->mVertices[v].z;
             }
 
             if(attributes[1])
             {
-                vertices.push_back(mesh->mTextureCoords[0][v].x);
-                vertices.push_back(mesh->mTextureCoords[0][v].y);
+                *v_out++ = mesh->mTextureCoords[0][v].x;
+                *v_out++ = mesh->mTextureCoords[0][v].y;
             }
 
             if(attributes[2])
             {
-                vertices.push_back(mesh->mNormals[v].x);
-                vertices.push_back(mesh->mNormals[v].y);
-                vertices.push_back(mesh->mNormals[v].z);
+                *v_out++ = mesh->mNormals[v].x;
+                *v_out++ = mesh->mNormals[v].y;
+                *v_out++ = mesh->mNormals[v].z;
             }
 
             if(attributes[3])
             {
-                vertices.push_back(mesh->mTangents[v].x);
-                vertices.push_back(mesh->mTangents[v].y);
-                vertices.push_back(mesh->mTangents[v].z);
+                *v_out++ = mesh->mTangents[v].x;
+                *v_out++ = mesh->mTangents[v].y;
+                *v_out++ = mesh->mTangents[v].z;
             }
         }
 
+        // faces are triangulated on import
+        indices.reserve(size_t(mesh->mNumFaces) * 3);
+
         for(uint32_t f = 0; f < mesh->mNumFaces; f++)
         {
-            struct aiFace face = mesh->mFaces[f];
+            const struct aiFace& face = mesh->mFaces[f];
             for(unsigned i = 0; i < face.mNumIndices; i++)
             {
                 indices.push_back(face.mIndices[i]);
             }
         }
 
-        Mesh m = Mesh().createFromData(vertices, indices);
-        m.setVertexSize(single_vertex_size);
+        unsigned vertex_count = mesh->mNumVertices;
+
+        if(settings.optimize)
+        {
+            // -------- reorder for the post-transform cache, then overdraw, then vertex fetch
+            if(stats)
+            {
+                stats->before = MeshOptimizer::analyzeVertexCache(indices.data(), indices.size(), vertex_count);
+            }
+
+            std::vector<unsigned> reordered(indices.size());
+            MeshOptimizer::optimizeVertexCache(reordered.data(), indices.data(), indices.size(), vertex_count);
+            indices.swap(reordered);
 
+            if(attributes[0])
+            {
+                MeshOptimizer::optimizeOverdraw(indices.data(), indices.size(), &vertices[offsets[0]], single_vertex_size, vertex_count);
+            }
+
+            vertex_count = MeshOptimizer::optimizeVertexFetch(vertices.data(), indices.data(), indices.size(), vertex_count, single_vertex_size);
+            vertices.resize(size_t(vertex_count) * single_vertex_size);
+
+            if(stats)
+            {
+                stats->after = MeshOptimizer::analyzeVertexCache(indices.data(), indices.size(), vertex_count);
+            }
+        }
+
+        if(attributes[0])
+        {
+            MeshBounds b = Mesh::computeBounds(&vertices[offsets[0]], vertex_count, single_vertex_size);
+            const float lo[3] = {b.min.x, b.min.y, b.min.z};
+            const float hi[3] = {b.max.x, b.max.y, b.max.z};
+            const float c[3] = {b.center.x, b.center.y, b.center.z};
+
+            memcpy(cooked.layout.bounds_min, lo, sizeof(lo));
+            memcpy(cooked.layout.bounds_max, hi, sizeof(hi));
+            memcpy(cooked.layout.sphere_center, c, sizeof(c));
+            cooked.layout.sphere_radius = b.radius;
+        }
+
+        packIndices(indices, vertex_count, cooked);
+
+        cooked.layout.vertex_stride = single_vertex_size * sizeof(float);
         for(int i = 0; i < 4; i++)
         {
-            if(attributes[i])
-                m.addVertexAttrib(i, sizes[i]);
+            cooked.layout.attribs[i].size = attributes[i] ? sizes[i] : 0;
+            cooked.layout.attribs[i].type = unsigned(AttribType::Float);
+            cooked.layout.attribs[i].normalized = 0;
         }
 
-        m.complete();
+        cooked.layout.vertex_bytes = vertices.size() * sizeof(float);
+        cooked.vertices.resize(cooked.layout.vertex_bytes);
+        memcpy(cooked.vertices.data(), vertices.data(), cooked.vertices.size());
 
-        return m;
+        if(settings.position_stream)
+        {
+            extractPositions(vertex_count, cooked);
+        }
     }
 
     std::vector<m3d::vec3> Mesh::loadVertices(std::string filepath)
@@ -0,0 +1,241 @@
+#include "DragonEngine/MeshArena.h"
+#include "d_internal.h"
+
+#include <glad/glad.h>
+
+namespace dgn
+{
+    // immutable storage needs gl 4.4, older contexts get a plain mutable buffer that glBufferSubData can fill just the same
+    static void allocateBuffer(GLenum target, size_t size)
+    {
+        if(GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage)
+        {
+            glCall(glBufferStorage(target, size, nullptr, GL_DYNAMIC_STORAGE_BIT));
+        }
+        else
+        {
+            glCall(glBufferData(target, size, nullptr, GL_DYNAMIC_DRAW));
+        }
+    }
+
+    MeshArena::MeshArena() : m_vao(0), m_vbo(0), m_ibo(0), m_position_vao(0), m_position_vbo(0),
+        m_vertex_stride(0), m_position_stride(0), m_vertex_capacity(0), m_index_capacity(0), m_index_type(IndexType::UnsignedShort),
+        m_vertex_count(0), m_index_count(0) {}
+
+    void MeshArena::dispose()
+    {
+        glCall(glDeleteVertexArrays(1, &m_vao));
+        glCall(glDeleteBuffers(1, &m_vbo));
+        glCall(glDeleteBuffers(1, &m_ibo));
+
+        if(m_position_vao)
+        {
+            glCall(glDeleteVertexArrays(1, &m_position_vao));
+            glCall(glDeleteBuffers(1, &m_position_vbo));
+        }
+
+        invalidateGLStateInternal();
+        m_vao = m_vbo = m_ibo = m_position_vao = m_position_vbo = 0;
+        m_vertex_count = 0;
+        m_index_count = 0;
+        m_attribs.clear();
+    }
+
+    MeshArena& MeshArena::create(unsigned vertex_stride, unsigned vertex_capacity, unsigned index_capacity, IndexType index_type)
+    {
+        m_vertex_stride = vertex_stride;
+        m_vertex_capacity = vertex_capacity;
+        m_index_capacity = index_capacity;
+        m_index_type = index_type;
+        m_vertex_count = 0;
+        m_index_count = 0;
+
+        glCall(glGenVertexArrays(1, &m_vao));
+        glCall(glGenBuffers(1, &m_vbo));
+        glCall(glGenBuffers(1, &m_ibo));
+
+        // -------- Index Data
+        glCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo));
+        allocateBuffer(GL_ELEMENT_ARRAY_BUFFER, size_t(index_capacity) * indexTypeSize(index_type));
+        glCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+
+        // -------- Vertex Data
+        glCall(glBindVertexArray(m_vao));
+        invalidateGLStateInternal();
+        glCall(glBindBuffer(GL_ARRAY_BUFFER, m_vbo));
+        allocateBuffer(GL_ARRAY_BUFFER, size_t(vertex_capacity) * vertex_stride);
+
+        return *this;
+    }
+
+    MeshArena& MeshArena::addVertexAttrib(unsigned location, int size, AttribType type, bool normalized)
+    {
+        unsigned offset = 0;
+        for(const Attrib& a : m_attribs)
+        {
+            offset += attribTypeSize(a.type, a.size);
+        }
+
+        glCall(glVertexAttribPointer(location, size, int(type), normalized ? GL_TRUE : GL_FALSE, m_vertex_stride, (void*)(uintptr_t)offset));
+        glCall(glEnableVertexAttribArray(location));
+
+        m_attribs.push_back({location, size, type, normalized});
+
+        return *this;
+    }
+
+    MeshArena& MeshArena::addPositionStream()
+    {
+        const Attrib *position = nullptr;
+        for(const Attrib& a : m_attribs)
+        {
+            if(a.location == 0) position = &a;
+        }
+
+        if(!position)
+        {
+            logError("MESH ARENA", "position stream needs attribute 0");
+            return *this;
+        }
+
+        m_position_stride = attribTypeSize(position->type, position->size);
+
+        glCall(glGenVertexArrays(1, &m_position_vao));
+        glCall(glGenBuffers(1, &m_position_vbo));
+
+        glCall(glBindVertexArray(m_position_vao));
+        invalidateGLStateInternal();
+        glCall(glBindBuffer(GL_ARRAY_BUFFER, m_position_vbo));
+        allocateBuffer(GL_ARRAY_BUFFER, size_t(m_vertex_capacity) * m_position_stride);
+
+        glCall(glVertexAttribPointer(0, position->size, int(position->type), position->normalized ? GL_TRUE : GL_FALSE, 0, nullptr));
+        glCall(glEnableVertexAttribArray(0));
+
+        // leave the main vertex array bound so more attributes go to it
+        glCall(glBindVertexArray(m_vao));
+        invalidateGLStateInternal();
+        glCall(glBindBuffer(GL_ARRAY_BUFFER, m_vbo));
+
+        return *this;
+    }
+
+    MeshArena& MeshArena::complete()
+    {
+        glCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        glCall(glBindVertexArray(0));
+        invalidateGLStateInternal();
+
+        return *this;
+    }
+
+    unsigned MeshArena::getVertexStride() const
+    {
+        return m_vertex_stride;
+    }
+
+    unsigned MeshArena::getVertexAttribCount() const
+    {
+        return m_attribs.size();
+    }
+
+    bool MeshArena::hasVertexAttrib(unsigned location, int size, AttribType type, bool normalized) const
+    {
+        for(const Attrib& a : m_attribs)
+        {
+            if(a.location == location)
+            {
+                return a.size == size && a.type == type && a.normalized == normalized;
+            }
+        }
+
+        return false;
+    }
+
+    bool MeshArena::hasPositionStream() const
+    {
+        return m_position_vao != 0;
+    }
+
+    bool MeshArena::allocate(Mesh& mesh, const void* vertex_data, unsigned vertex_count, const void* index_data, unsigned index_count,
+                             IndexType index_type, const void* position_data)
+    {
+        if(m_vertex_count + vertex_count > m_vertex_capacity || m_index_count + index_count > m_index_capacity) return false;
+        if(m_position_vao && position_data == nullptr) return false;
+
+        // with a base vertex per mesh, 16 bit arena indices only need to address the mesh's own vertices
+        if(m_index_type == IndexType::UnsignedShort && vertex_count > 65536) return false;
+
+        std::vector<unsigned char> converted;
+        if(index_type != m_index_type)
+        {
+            converted.resize(index_count * indexTypeSize(m_index_type));
+
+            for(unsigned i = 0; i < index_count; i++)
+            {
+                uint32_t index = index_type == IndexType::UnsignedShort ? ((const uint16_t*)index_data)[i] : ((const uint32_t*)index_data)[i];
+
+                if(m_index_type == IndexType::UnsignedShort)
+                    ((uint16_t*)converted.data())[i] = uint16_t(index);
+                else
+                    ((uint32_t*)converted.data())[i] = index;
+            }
+
+            index_data = converted.data();
+        }
+
+        unsigned index_size = indexTypeSize(m_index_type);
+
+        glCall(glBindBuffer(GL_ARRAY_BUFFER, m_vbo));
+        glCall(glBufferSubData(GL_ARRAY_BUFFER, m_vertex_count * m_vertex_stride, vertex_count * m_vertex_stride, vertex_data));
+
+        if(m_position_vao)
+        {
+            glCall(glBindBuffer(GL_ARRAY_BUFFER, m_position_vbo));
+            glCall(glBufferSubData(GL_ARRAY_BUFFER, m_vertex_count * m_position_stride, vertex_count * m_position_stride, position_data));
+        }
+
+        glCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+        // upload through the copy target so no vertex array's element binding is touched
+        glCall(glBindBuffer(GL_COPY_WRITE_BUFFER, m_ibo));
+        glCall(glBufferSubData(GL_COPY_WRITE_BUFFER, m_index_count * index_size, index_count * index_size, index_data));
+        glCall(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+
+        mesh.m_vao = m_vao;
+        mesh.m_vbo = m_vbo;
+        mesh.m_ibo = m_ibo;
+        mesh.m_position_vao = m_position_vao;
+        mesh.m_position_vbo = m_position_vbo;
+        mesh.m_length = index_count;
+        mesh.m_index_type = m_index_type;
+        mesh.m_first_index = m_index_count;
+        mesh.m_base_vertex = m_vertex_count;
+        mesh.m_arena_allocated = true;
+        mesh.m_disposed = false;
+
+        m_vertex_count += vertex_count;
+        m_index_count += index_count;
+
+        return true;
+    }
+
+    unsigned MeshArena::getVertexCount() const
+    {
+        return m_vertex_count;
+    }
+
+    unsigned MeshArena::getIndexCount() const
+    {
+        return m_index_count;
+    }
+
+    unsigned MeshArena::getVertexCapacity() const
+    {
+        return m_vertex_capacity;
+    }
+
+    unsigned MeshArena::getIndexCapacity() const
+    {
+        return m_index_capacity;
+    }
+}
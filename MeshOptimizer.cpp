@@ -0,0 +1,439 @@
+#include "DragonEngine/MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace dgn
+{
+    ////////////////////////////////////////
+    //          CACHE SIMULATION          //
+    ////////////////////////////////////////
+
+    // FIFO cache simulated with per vertex timestamps
+    struct FifoCache
+    {
+        std::vector<unsigned> timestamps;
+        unsigned time;
+        unsigned size;
+
+        FifoCache(unsigned vertex_count, unsigned cache_size) :
+            timestamps(vertex_count, 0), time(cache_size + 1), size(cache_size) {}
+
+        // returns true on a miss
+        bool access(unsigned v)
+        {
+            if(time - timestamps[v] > size)
+            {
+                timestamps[v] = time++;
+                return true;
+            }
+
+            return false;
+        }
+
+        void reset()
+        {
+            time += size + 1;
+        }
+    };
+
+    VertexCacheStats MeshOptimizer::analyzeVertexCache(const unsigned* indices, unsigned index_count, unsigned vertex_count, unsigned cache_size)
+    {
+        VertexCacheStats res = {0.0f, 0.0f};
+        if(index_count < 3 || vertex_count == 0) return res;
+
+        FifoCache cache(vertex_count, cache_size);
+        std::vector<bool> referenced(vertex_count, false);
+
+        unsigned misses = 0;
+        unsigned unique = 0;
+
+        for(unsigned i = 0; i < index_count; i++)
+        {
+            unsigned v = indices[i];
+
+            if(cache.access(v)) misses++;
+
+            if(!referenced[v])
+            {
+                referenced[v] = true;
+                unique++;
+            }
+        }
+
+        res.acmr = float(misses) / float(index_count / 3);
+        res.atvr = float(misses) / float(unique);
+
+        return res;
+    }
+
+    ////////////////////////////////////////
+    //          VERTEX CACHE              //
+    ////////////////////////////////////////
+
+    const int FORSYTH_CACHE_SIZE = 32;
+    const int FORSYTH_MAX_VALENCE = 32;
+
+    static float forsythCacheScore[FORSYTH_CACHE_SIZE];
+    static float forsythValenceScore[FORSYTH_MAX_VALENCE + 1];
+
+    static void initForsythTables()
+    {
+        static bool initialized = false;
+        if(initialized) return;
+
+        for(int i = 0; i < FORSYTH_CACHE_SIZE; i++)
+        {
+            // the last triangle's vertices get a fixed score so it is not reused immediately
+            if(i < 3)
+            {
+                forsythCacheScore[i] = 0.75f;
+            }
+            else
+            {
+                float scaler = 1.0f - float(i - 3) / float(FORSYTH_CACHE_SIZE - 3);
+                forsythCacheScore[i] = std::pow(scaler, 1.5f);
+            }
+        }
+
+        forsythValenceScore[0] = 0.0f;
+        for(int i = 1; i <= FORSYTH_MAX_VALENCE; i++)
+        {
+            // boost vertices with few triangles left to get rid of lone triangles
+            forsythValenceScore[i] = 2.0f / std::sqrt(float(i));
+        }
+
+        initialized = true;
+    }
+
+    static float forsythVertexScore(int cache_position, unsigned live_triangles)
+    {
+        if(live_triangles == 0) return -1.0f;
+
+        float score = cache_position >= 0 ? forsythCacheScore[cache_position] : 0.0f;
+        return score + forsythValenceScore[std::min<unsigned>(live_triangles, FORSYTH_MAX_VALENCE)];
+    }
+
+    void MeshOptimizer::optimizeVertexCache(unsigned* destination, const unsigned* indices, unsigned index_count, unsigned vertex_count)
+    {
+        unsigned face_count = index_count / 3;
+        if(face_count == 0) return;
+
+        initForsythTables();
+
+        // -------- vertex to triangle adjacency
+        std::vector<unsigned> live_triangles(vertex_count, 0);
+        for(unsigned i = 0; i < face_count * 3; i++)
+        {
+            live_triangles[indices[i]]++;
+        }
+
+        std::vector<unsigned> offsets(vertex_count + 1, 0);
+        for(unsigned v = 0; v < vertex_count; v++)
+        {
+            offsets[v + 1] = offsets[v] + live_triangles[v];
+        }
+
+        std::vector<unsigned> adjacency(face_count * 3);
+        std::vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+        for(unsigned f = 0; f < face_count; f++)
+        {
+            for(unsigned k = 0; k < 3; k++)
+            {
+                unsigned v = indices[f * 3 + k];
+                adjacency[fill[v]++] = f;
+            }
+        }
+
+        // -------- initial scores
+        std::vector<int> cache_position(vertex_count, -1);
+        std::vector<float> vertex_score(vertex_count);
+        for(unsigned v = 0; v < vertex_count; v++)
+        {
+            vertex_score[v] = forsythVertexScore(-1, live_triangles[v]);
+        }
+
+        std::vector<float> triangle_score(face_count);
+        std::vector<bool> emitted(face_count, false);
+        for(unsigned f = 0; f < face_count; f++)
+        {
+            triangle_score[f] = vertex_score[indices[f * 3 + 0]] +
+                                vertex_score[indices[f * 3 + 1]] +
+                                vertex_score[indices[f * 3 + 2]];
+        }
+
+        unsigned cache[FORSYTH_CACHE_SIZE + 3];
+        unsigned cache_count = 0;
+
+        unsigned best = 0;
+        for(unsigned f = 1; f < face_count; f++)
+        {
+            if(triangle_score[f] > triangle_score[best]) best = f;
+        }
+
+        unsigned input_cursor = 0;
+        unsigned output = 0;
+
+        while(true)
+        {
+            const unsigned *tri = &indices[best * 3];
+
+            destination[output++] = tri[0];
+            destination[output++] = tri[1];
+            destination[output++] = tri[2];
+            emitted[best] = true;
+
+            if(output == face_count * 3) break;
+
+            // -------- remove the triangle from its vertices' adjacency
+            for(unsigned k = 0; k < 3; k++)
+            {
+                unsigned v = tri[k];
+                unsigned *begin = &adjacency[offsets[v]];
+                unsigned *end = begin + live_triangles[v];
+
+                unsigned *it = std::find(begin, end, best);
+                if(it != end)
+                {
+                    *it = *(end - 1);
+                    live_triangles[v]--;
+                }
+            }
+
+            // -------- push the triangle to the front of the cache
+            unsigned new_cache[FORSYTH_CACHE_SIZE + 3];
+            unsigned new_count = 0;
+
+            new_cache[new_count++] = tri[0];
+            new_cache[new_count++] = tri[1];
+            new_cache[new_count++] = tri[2];
+
+            for(unsigned i = 0; i < cache_count; i++)
+            {
+                unsigned v = cache[i];
+                if(v != tri[0] && v != tri[1] && v != tri[2])
+                {
+                    new_cache[new_count++] = v;
+                }
+            }
+
+            // vertices pushed out of the cache lose their cache score
+            for(unsigned i = FORSYTH_CACHE_SIZE; i < new_count; i++)
+            {
+                unsigned v = new_cache[i];
+                cache_position[v] = -1;
+                vertex_score[v] = forsythVertexScore(-1, live_triangles[v]);
+            }
+
+            cache_count = std::min<unsigned>(new_count, FORSYTH_CACHE_SIZE);
+            std::copy(new_cache, new_cache + cache_count, cache);
+
+            // -------- rescore everything touching the cache and pick the next triangle from it
+            for(unsigned i = 0; i < cache_count; i++)
+            {
+                unsigned v = cache[i];
+                cache_position[v] = i;
+                vertex_score[v] = forsythVertexScore(i, live_triangles[v]);
+            }
+
+            float best_score = -1.0f;
+            bool found = false;
+
+            for(unsigned i = 0; i < cache_count; i++)
+            {
+                unsigned v = cache[i];
+                const unsigned *adj = &adjacency[offsets[v]];
+
+                for(unsigned t = 0; t < live_triangles[v]; t++)
+                {
+                    unsigned f = adj[t];
+                    float score = vertex_score[indices[f * 3 + 0]] +
+                                  vertex_score[indices[f * 3 + 1]] +
+                                  vertex_score[indices[f * 3 + 2]];
+                    triangle_score[f] = score;
+
+                    if(score > best_score)
+                    {
+                        best_score = score;
+                        best = f;
+                        found = true;
+                    }
+                }
+            }
+
+            // cache has no live triangles left, continue with the next one in input order
+            if(!found)
+            {
+                while(emitted[input_cursor]) input_cursor++;
+                best = input_cursor;
+            }
+        }
+    }
+
+    ////////////////////////////////////////
+    //              OVERDRAW              //
+    ////////////////////////////////////////
+
+    struct OverdrawCluster
+    {
+        unsigned start;
+        unsigned count;
+        float sort_key;
+    };
+
+    static unsigned triangleMisses(FifoCache& cache, const unsigned* tri)
+    {
+        return unsigned(cache.access(tri[0])) + unsigned(cache.access(tri[1])) + unsigned(cache.access(tri[2]));
+    }
+
+    void MeshOptimizer::optimizeOverdraw(unsigned* indices, unsigned index_count, const float* positions, unsigned stride,
+                                         unsigned vertex_count, float threshold)
+    {
+        unsigned face_count = index_count / 3;
+        if(face_count == 0 || vertex_count == 0) return;
+
+        FifoCache cache(vertex_count, 16);
+
+        // -------- hard boundaries, wherever a triangle misses on every vertex the cache is effectively cold
+        std::vector<unsigned> hard;
+        for(unsigned f = 0; f < face_count; f++)
+        {
+            if(triangleMisses(cache, &indices[f * 3]) == 3)
+            {
+                hard.push_back(f);
+            }
+        }
+        hard.push_back(face_count);
+
+        // -------- soft boundaries, split a hard cluster as soon as its running ACMR is within the threshold
+        std::vector<OverdrawCluster> clusters;
+        for(unsigned h = 0; h + 1 < hard.size(); h++)
+        {
+            unsigned begin = hard[h];
+            unsigned end = hard[h + 1];
+
+            cache.reset();
+            unsigned cluster_misses = 0;
+            for(unsigned f = begin; f < end; f++)
+            {
+                cluster_misses += triangleMisses(cache, &indices[f * 3]);
+            }
+
+            float cluster_threshold = threshold * float(cluster_misses) / float(end - begin);
+
+            cache.reset();
+            unsigned start = begin;
+            unsigned misses = 0;
+            for(unsigned f = begin; f < end; f++)
+            {
+                misses += triangleMisses(cache, &indices[f * 3]);
+
+                if(f + 1 == end || float(misses) / float(f - start + 1) <= cluster_threshold)
+                {
+                    clusters.push_back({start, f - start + 1, 0.0f});
+
+                    cache.reset();
+                    start = f + 1;
+                    misses = 0;
+                }
+            }
+        }
+
+        // -------- mesh centroid
+        double mesh_center[3] = {0.0, 0.0, 0.0};
+        for(unsigned v = 0; v < vertex_count; v++)
+        {
+            for(unsigned k = 0; k < 3; k++) mesh_center[k] += positions[v * stride + k];
+        }
+        for(unsigned k = 0; k < 3; k++) mesh_center[k] /= vertex_count;
+
+        // -------- sort key, how far a cluster sits out along its own average normal
+        for(OverdrawCluster& c : clusters)
+        {
+            float center[3] = {0.0f, 0.0f, 0.0f};
+            float normal[3] = {0.0f, 0.0f, 0.0f};
+            float total_area = 0.0f;
+
+            for(unsigned f = c.start; f < c.start + c.count; f++)
+            {
+                const float *p0 = &positions[indices[f * 3 + 0] * stride];
+                const float *p1 = &positions[indices[f * 3 + 1] * stride];
+                const float *p2 = &positions[indices[f * 3 + 2] * stride];
+
+                float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+                float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+
+                // cross product length is twice the area, the scale cancels out below
+                float n[3] =
+                {
+                    e1[1] * e2[2] - e1[2] * e2[1],
+                    e1[2] * e2[0] - e1[0] * e2[2],
+                    e1[0] * e2[1] - e1[1] * e2[0]
+                };
+                float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+                for(unsigned k = 0; k < 3; k++)
+                {
+                    center[k] += (p0[k] + p1[k] + p2[k]) / 3.0f * area;
+                    normal[k] += n[k];
+                }
+                total_area += area;
+            }
+
+            if(total_area <= 0.0f) continue;
+
+            float normal_length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            if(normal_length <= 0.0f) continue;
+
+            c.sort_key = 0.0f;
+            for(unsigned k = 0; k < 3; k++)
+            {
+                c.sort_key += (center[k] / total_area - float(mesh_center[k])) * normal[k] / normal_length;
+            }
+        }
+
+        // outward facing clusters first, they are the most likely to occlude the rest
+        std::stable_sort(clusters.begin(), clusters.end(), [](const OverdrawCluster& a, const OverdrawCluster& b)
+        {
+            return a.sort_key > b.sort_key;
+        });
+
+        std::vector<unsigned> source(indices, indices + face_count * 3);
+        unsigned output = 0;
+        for(const OverdrawCluster& c : clusters)
+        {
+            std::copy(&source[c.start * 3], &source[(c.start + c.count) * 3], &indices[output]);
+            output += c.count * 3;
+        }
+    }
+
+    ////////////////////////////////////////
+    //            VERTEX FETCH            //
+    ////////////////////////////////////////
+
+    unsigned MeshOptimizer::optimizeVertexFetch(float* vertices, unsigned* indices, unsigned index_count, unsigned vertex_count, unsigned vertex_size)
+    {
+        const unsigned unused = ~0u;
+        std::vector<unsigned> remap(vertex_count, unused);
+        unsigned next = 0;
+
+        for(unsigned i = 0; i < index_count; i++)
+        {
+            unsigned& r = remap[indices[i]];
+            if(r == unused) r = next++;
+            indices[i] = r;
+        }
+
+        std::vector<float> source(vertices, vertices + size_t(vertex_count) * vertex_size);
+        for(unsigned v = 0; v < vertex_count; v++)
+        {
+            if(remap[v] == unused) continue;
+
+            std::copy(&source[size_t(v) * vertex_size], &source[size_t(v + 1) * vertex_size],
+                      &vertices[size_t(remap[v]) * vertex_size]);
+        }
+
+        return next;
+    }
+}
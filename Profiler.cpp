@@ -0,0 +1,177 @@
+#include "DragonEngine/Profiler.h"
+#include "d_internal.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <string>
+
+namespace dgn
+{
+    struct ProfileEventInternal
+    {
+        const char *name;
+        uint64_t start;
+        uint64_t duration;
+    };
+
+    // Written only by the thread that owns it, so recording takes no lock. The count is published with
+    // release order after the event is written, so a trace dump from another thread only reads finished events.
+    // Chunks are never moved or freed while the program runs.
+    struct ThreadTraceInternal
+    {
+        static const unsigned CHUNK_SIZE = 4096;
+        static const unsigned MAX_CHUNKS = 256;
+
+        ProfileEventInternal *chunks[MAX_CHUNKS] = {};
+        std::atomic<unsigned> count{0};
+        unsigned id = 0;
+    };
+
+    static std::atomic<bool> s_profiling{false};
+    static std::atomic<unsigned> s_dropped{0};
+
+    // only touched when a thread records its first scope or exits, and when dumping
+    static std::mutex s_traces_mutex;
+    static std::vector<ThreadTraceInternal*> s_traces;
+    static std::vector<ThreadTraceInternal*> s_free_traces;
+
+    static const std::chrono::steady_clock::time_point s_epoch = std::chrono::steady_clock::now();
+
+    static uint64_t nowInternal()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_epoch).count();
+    }
+
+    // Threads that exit hand their buffer to the next new thread, so short lived workers spawned every frame
+    // share a few trace rows instead of adding one each
+    struct ThreadTraceOwnerInternal
+    {
+        ThreadTraceInternal *trace = nullptr;
+
+        ~ThreadTraceOwnerInternal()
+        {
+            if(!trace) return;
+
+            std::lock_guard<std::mutex> lock(s_traces_mutex);
+            s_free_traces.push_back(trace);
+        }
+    };
+
+    static thread_local ThreadTraceOwnerInternal s_owner;
+
+    static ThreadTraceInternal *threadTraceInternal()
+    {
+        if(s_owner.trace) return s_owner.trace;
+
+        std::lock_guard<std::mutex> lock(s_traces_mutex);
+        if(!s_free_traces.empty())
+        {
+            s_owner.trace = s_free_traces.back();
+            s_free_traces.pop_back();
+        }
+        else
+        {
+            s_owner.trace = new ThreadTraceInternal();
+            s_owner.trace->id = s_traces.size();
+            s_traces.push_back(s_owner.trace);
+        }
+
+        return s_owner.trace;
+    }
+
+    void setCpuProfiling(bool enabled)
+    {
+        s_profiling.store(enabled, std::memory_order_relaxed);
+    }
+
+    bool isCpuProfiling()
+    {
+        return s_profiling.load(std::memory_order_relaxed);
+    }
+
+    void clearCpuTrace()
+    {
+        std::lock_guard<std::mutex> lock(s_traces_mutex);
+        for(ThreadTraceInternal *trace : s_traces)
+        {
+            trace->count.store(0, std::memory_order_release);
+        }
+
+        s_dropped = 0;
+    }
+
+    ProfileScope::ProfileScope(const char* name) : m_name(nullptr), m_start(0)
+    {
+        if(!s_profiling.load(std::memory_order_relaxed)) return;
+
+        m_name = name;
+        m_start = nowInternal();
+    }
+
+    ProfileScope::~ProfileScope()
+    {
+        if(!m_name) return;
+
+        uint64_t end = nowInternal();
+
+        ThreadTraceInternal *trace = threadTraceInternal();
+        unsigned index = trace->count.load(std::memory_order_relaxed);
+        unsigned chunk = index / ThreadTraceInternal::CHUNK_SIZE;
+
+        if(chunk >= ThreadTraceInternal::MAX_CHUNKS)
+        {
+            s_dropped++;
+            return;
+        }
+
+        if(!trace->chunks[chunk])
+        {
+            trace->chunks[chunk] = new ProfileEventInternal[ThreadTraceInternal::CHUNK_SIZE];
+        }
+
+        ProfileEventInternal& event = trace->chunks[chunk][index % ThreadTraceInternal::CHUNK_SIZE];
+        event.name = m_name;
+        event.start = m_start;
+        event.duration = end - m_start;
+
+        trace->count.store(index + 1, std::memory_order_release);
+    }
+
+    bool writeCpuTrace(const char* filepath)
+    {
+        FILE *file = fopen(filepath, "w");
+        if(!file)
+        {
+            logError("CPU PROFILER", (std::string("could not write ") + filepath).c_str());
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(s_traces_mutex);
+
+        fprintf(file, "{\"traceEvents\":[\n");
+
+        bool first = true;
+        for(ThreadTraceInternal *trace : s_traces)
+        {
+            unsigned count = trace->count.load(std::memory_order_acquire);
+
+            for(unsigned i = 0; i < count; i++)
+            {
+                const ProfileEventInternal& event = trace->chunks[i / ThreadTraceInternal::CHUNK_SIZE][i % ThreadTraceInternal::CHUNK_SIZE];
+
+                fprintf(file, "%s{\"name\":\"", first ? "" : ",\n");
+                writeEscapedInternal(file, event.name);
+                fprintf(file, "\",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%u}",
+                        event.start / 1000.0, event.duration / 1000.0, trace->id);
+                first = false;
+            }
+        }
+
+        fprintf(file, "\n],\"otherData\":{\"dropped\":%u}}\n", s_dropped.load());
+
+        fclose(file);
+        return true;
+    }
+}
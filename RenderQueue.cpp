@@ -0,0 +1,158 @@
+#include "DragonEngine/RenderQueue.h"
+#include "DragonEngine/Renderer.h"
+#include "d_internal.h"
+
+#include <m3d/vec4.h>
+
+#include <algorithm>
+#include <string.h>
+
+namespace dgn
+{
+    static const unsigned PASS_SHIFT     = 60;
+    static const unsigned SHADER_SHIFT   = 48;
+    static const unsigned MATERIAL_SHIFT = 32;
+
+    static const unsigned MAX_SHADER_IDS   = 1 << 12;
+    static const unsigned MAX_MATERIAL_IDS = 1 << 16;
+
+    unsigned RenderQueue::idInternal(std::unordered_map<const void*, unsigned>& ids, const void* ptr, unsigned max)
+    {
+        auto it = ids.find(ptr);
+        if(it != ids.end()) return it->second;
+
+        // past the limit items still draw correctly, they only stop grouping by this state
+        unsigned id = ids.size() < max ? ids.size() : max - 1;
+        ids[ptr] = id;
+
+        return id;
+    }
+
+    void RenderQueue::clear()
+    {
+        m_items.clear();
+        m_keys.clear();
+        m_order.clear();
+    }
+
+    void RenderQueue::setViewPosition(const m3d::vec3& position)
+    {
+        m_view_position = position;
+    }
+
+    void RenderQueue::submit(unsigned pass, const RenderItem& item, bool back_to_front)
+    {
+        if(pass >= MAX_PASSES)
+        {
+            logError("RENDER QUEUE", "pass out of range");
+            return;
+        }
+
+        const MeshBounds& bounds = item.mesh->getBounds();
+        m3d::vec4 center = item.transform * m3d::vec4(bounds.center.x, bounds.center.y, bounds.center.z, 1.0f);
+        float depth = m3d::vec3::distance(m_view_position, m3d::vec3(center.x, center.y, center.z));
+
+        // non negative floats sort the same as their bits
+        uint32_t depth_bits;
+        memcpy(&depth_bits, &depth, sizeof(depth_bits));
+        if(back_to_front) depth_bits = ~depth_bits;
+
+        uint64_t key = (uint64_t(pass) << PASS_SHIFT) |
+                       (uint64_t(idInternal(m_shader_ids, item.shader, MAX_SHADER_IDS)) << SHADER_SHIFT) |
+                       (uint64_t(idInternal(m_material_ids, item.textures, MAX_MATERIAL_IDS)) << MATERIAL_SHIFT) |
+                       depth_bits;
+
+        m_order.push_back(m_items.size());
+        m_items.push_back(item);
+        m_keys.push_back(key);
+    }
+
+    void RenderQueue::sort()
+    {
+        size_t count = m_keys.size();
+        if(count < 2) return;
+
+        m_keys_temp.resize(count);
+        m_order_temp.resize(count);
+
+        for(unsigned shift = 0; shift < 64; shift += 8)
+        {
+            size_t offsets[256] = {};
+            for(size_t i = 0; i < count; i++)
+            {
+                offsets[(m_keys[i] >> shift) & 0xFF]++;
+            }
+
+            // every key has the same byte here, nothing would move
+            if(offsets[(m_keys[0] >> shift) & 0xFF] == count) continue;
+
+            size_t sum = 0;
+            for(unsigned b = 0; b < 256; b++)
+            {
+                size_t c = offsets[b];
+                offsets[b] = sum;
+                sum += c;
+            }
+
+            for(size_t i = 0; i < count; i++)
+            {
+                size_t dst = offsets[(m_keys[i] >> shift) & 0xFF]++;
+                m_keys_temp[dst] = m_keys[i];
+                m_order_temp[dst] = m_order[i];
+            }
+
+            m_keys.swap(m_keys_temp);
+            m_order.swap(m_order_temp);
+        }
+    }
+
+    unsigned RenderQueue::size() const
+    {
+        return m_items.size();
+    }
+
+    const RenderItem& RenderQueue::getItem(unsigned index) const
+    {
+        return m_items[m_order[index]];
+    }
+
+    void RenderQueue::execute(Renderer& renderer, unsigned pass, const m3d::mat4x4& view_projection) const
+    {
+        size_t first = std::lower_bound(m_keys.begin(), m_keys.end(), uint64_t(pass) << PASS_SHIFT) - m_keys.begin();
+
+        const Shader *shader = nullptr;
+        const Texture *textures = nullptr;
+        const Mesh *mesh = nullptr;
+
+        for(size_t i = first; i < m_keys.size() && (m_keys[i] >> PASS_SHIFT) == pass; i++)
+        {
+            const RenderItem& item = m_items[m_order[i]];
+
+            if(item.shader != shader)
+            {
+                renderer.bindShader(*item.shader);
+                shader = item.shader;
+            }
+
+            if(item.textures != textures)
+            {
+                for(unsigned t = 0; t < item.texture_count; t++)
+                {
+                    renderer.bindTexture(item.textures[t], t);
+                }
+                textures = item.textures;
+            }
+
+            if(item.mesh != mesh)
+            {
+                renderer.bindMesh(*item.mesh);
+                mesh = item.mesh;
+            }
+
+            if(item.model_uniform >= 0) Shader::uniform(item.model_uniform, item.transform);
+            if(item.mvp_uniform >= 0) Shader::uniform(item.mvp_uniform, view_projection * item.transform);
+
+            renderer.drawBoundMesh();
+        }
+    }
+}
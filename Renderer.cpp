@@ -1,4 +1,7 @@
 #include "DragonEngine/Renderer.h"
+#include "DragonEngine/CommandList.h"
+#include "DragonEngine/ErrorString.h"
+#include "DragonEngine/GpuProfiler.h"
 
 #include "d_internal.h"
 
@@ -13,6 +16,12 @@ namespace dgn
         {
             return false;
         }
+
+#ifdef __DEBUG__
+        setDebugMode(DebugMode::Synchronous);
+#else
+        setDebugMode(DebugMode::Async);
+#endif
         return true;
     }
 
@@ -26,61 +35,317 @@ namespace dgn
         glCall(glClear(clear_flags));
     }
 
+    void Renderer::finish() const
+    {
+        glCall(glFinish());
+    }
+
+    /////////////////////////////////////
+    //          STATE CACHE            //
+    /////////////////////////////////////
+
+    void Renderer::invalidateState()
+    {
+        current_program = UNKNOWN_STATE;
+        current_vao = UNKNOWN_STATE;
+        current_ibo = UNKNOWN_STATE;
+        current_framebuffer = UNKNOWN_STATE;
+        current_texture_unit = UNKNOWN_STATE;
+        current_depth_func = UNKNOWN_STATE;
+        current_cull_face = UNKNOWN_STATE;
+        current_winding = UNKNOWN_STATE;
+        current_clip_mode = UNKNOWN_STATE;
+        current_blend[0] = current_blend[1] = UNKNOWN_STATE;
+
+        for(unsigned i = 0; i < MAX_TEXTURE_UNITS; i++) current_textures[i] = UNKNOWN_STATE;
+        for(unsigned i = 0; i < MAX_UNIFORM_BINDINGS; i++) current_uniform_buffers[i] = UNKNOWN_STATE;
+        for(unsigned i = 0; i < 4; i++) current_viewport[i] = UNKNOWN_STATE;
+        for(unsigned i = 0; i < RENDER_FLAG_COUNT; i++) current_flags[i] = UNKNOWN_STATE;
+
+        state_generation = glStateGenerationInternal();
+    }
+
+    const RenderStateStats& Renderer::getStateStats() const
+    {
+        return state_stats;
+    }
+
+    void Renderer::resetStateStats()
+    {
+        state_stats = RenderStateStats();
+    }
+
+    void Renderer::setProfiler(GpuProfiler* gpu_profiler)
+    {
+        profiler = gpu_profiler;
+    }
+
+    void Renderer::beginRegion(const char* name)
+    {
+        if(GLAD_GL_KHR_debug)
+        {
+            glCall(glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name));
+        }
+
+        if(profiler) profiler->beginScope(name);
+    }
+
+    void Renderer::endRegion()
+    {
+        if(profiler) profiler->endScope();
+
+        if(GLAD_GL_KHR_debug)
+        {
+            glCall(glPopDebugGroup());
+        }
+    }
+
+    void Renderer::syncStateInternal()
+    {
+        if(state_generation != glStateGenerationInternal())
+        {
+            invalidateState();
+        }
+    }
+
+    // returns true if value differs from the cached state and has to be sent to gl
+    bool Renderer::changeStateInternal(unsigned& current, unsigned value)
+    {
+        if(current == value)
+        {
+            state_stats.elided++;
+            return false;
+        }
+
+        current = value;
+        state_stats.issued++;
+        return true;
+    }
+
+    void Renderer::activeTextureInternal(unsigned slot)
+    {
+        if(changeStateInternal(current_texture_unit, slot))
+        {
+            glCall(glActiveTexture(GL_TEXTURE0 + slot));
+        }
+    }
+
     /////////////////////////////////////
     //            BINDING              //
     /////////////////////////////////////
 
+    // position only vertex array whenever the shader reads nothing but attribute 0 and per instance attributes
+    bool Renderer::positionOnlyInternal() const
+    {
+        return (bound_attrib_mask & ~(1u | bound_instance_mask)) == 0;
+    }
+
+    // the element buffer is vertex array state, so it only needs binding when the vertex array changes
+    void Renderer::bindVertexArrayInternal()
+    {
+        syncStateInternal();
+
+        bool position_only = bound_position_vao != 0 && positionOnlyInternal();
+        unsigned vao = position_only ? bound_position_vao : bound_vao;
+
+        if(current_vao == vao && current_ibo == bound_ibo)
+        {
+            state_stats.elided++;
+            return;
+        }
+
+        current_vao = vao;
+        current_ibo = bound_ibo;
+        state_stats.issued++;
+
+        glCall(glBindVertexArray(vao));
+        glCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bound_ibo));
+    }
+
     void Renderer::bindMesh(const Mesh& mesh)
     {
-        glCall(glBindVertexArray(mesh.m_vao));
-        glCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.m_ibo));
+        bound_vao = mesh.m_vao;
+        bound_position_vao = mesh.m_position_vao;
+        bound_ibo = mesh.m_ibo;
+        bound_instance_mask = mesh.m_instance_mask;
+        bindVertexArrayInternal();
         bound_mesh_size = mesh.m_length;
+        bound_index_type = mesh.m_index_type;
+        bound_first_index = mesh.m_first_index;
+        bound_base_vertex = mesh.m_base_vertex;
     }
 
-    void Renderer::bindShader(const Shader& shader) const
+    void Renderer::bindShader(const Shader& shader)
     {
-        glCall(glUseProgram(shader.m_program));
+        syncStateInternal();
+
+        // a shader without a program yet draws with its fallback
+        const Shader& active = shader.getActive();
+
+        if(changeStateInternal(current_program, active.m_program))
+        {
+            glCall(glUseProgram(active.m_program));
+        }
+
+        bool was_position_only = positionOnlyInternal();
+        bound_attrib_mask = active.m_attrib_mask;
+
+        if(bound_position_vao != 0 && was_position_only != positionOnlyInternal())
+        {
+            bindVertexArrayInternal();
+        }
     }
 
-    void Renderer::bindTexture(const Texture& texture, unsigned slot) const
+    void Renderer::bindTexture(const Texture& texture, unsigned slot)
     {
-        glCall(glActiveTexture(GL_TEXTURE0 + slot));
+        syncStateInternal();
 
+        if(slot < MAX_TEXTURE_UNITS)
+        {
+            if(!changeStateInternal(current_textures[slot], texture.m_texture)) return;
+        }
+        else
+        {
+            state_stats.issued++;
+        }
+
+        activeTextureInternal(slot);
         glCall(glBindTexture((unsigned)texture.getTextureType(), texture.m_texture));
     }
 
-    void Renderer::bindFramebuffer(const Framebuffer& framebuffer) const
+    void Renderer::bindUniformBuffer(const UniformBuffer& buffer, unsigned binding)
+    {
+        syncStateInternal();
+
+        if(binding < MAX_UNIFORM_BINDINGS)
+        {
+            if(!changeStateInternal(current_uniform_buffers[binding], buffer.m_buffer)) return;
+        }
+        else
+        {
+            state_stats.issued++;
+        }
+
+        glCall(glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer.m_buffer));
+    }
+
+    void Renderer::bindFramebuffer(const Framebuffer& framebuffer)
     {
-        glCall(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.m_buffer));
+        syncStateInternal();
+
+        if(changeStateInternal(current_framebuffer, framebuffer.m_buffer))
+        {
+            glCall(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.m_buffer));
+        }
     }
 
     void Renderer::unbindMesh()
     {
-        glCall(glBindVertexArray(0));
-        glCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
         bound_mesh_size = 0;
+        bound_first_index = 0;
+        bound_base_vertex = 0;
+        bound_vao = 0;
+        bound_position_vao = 0;
+        bound_ibo = 0;
+        bound_instance_mask = 0;
+        bindVertexArrayInternal();
     }
 
-    void Renderer::unbindShader() const
+    void Renderer::unbindShader()
     {
-        glCall(glUseProgram(0));
+        syncStateInternal();
+
+        if(changeStateInternal(current_program, 0))
+        {
+            glCall(glUseProgram(0));
+        }
+
+        bound_attrib_mask = ~0u;
     }
 
-    void Renderer::unbindTexture(unsigned slot) const
+    void Renderer::unbindTexture(unsigned slot)
     {
-        glCall(glActiveTexture(GL_TEXTURE0 + slot));
+        syncStateInternal();
+
+        if(slot < MAX_TEXTURE_UNITS)
+        {
+            if(!changeStateInternal(current_textures[slot], 0)) return;
+        }
+        else
+        {
+            state_stats.issued++;
+        }
 
+        activeTextureInternal(slot);
         glCall(glBindTexture(GL_TEXTURE_2D, 0));
     }
 
-    void Renderer::unbindFramebuffer() const
+    void Renderer::unbindFramebuffer()
     {
-        glCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+        syncStateInternal();
+
+        if(changeStateInternal(current_framebuffer, 0))
+        {
+            glCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+        }
     }
 
     void Renderer::drawBoundMesh() const
     {
-        glCall(glDrawElements(int(draw_mode), bound_mesh_size, GL_UNSIGNED_INT, nullptr));
+        drawBoundMeshRange(0, bound_mesh_size);
+    }
+
+    void Renderer::drawBoundMeshRange(unsigned first_index, unsigned count) const
+    {
+        uintptr_t offset = uintptr_t(bound_first_index + first_index) * indexTypeSize(bound_index_type);
+
+        glCall(glDrawElementsBaseVertex(int(draw_mode), count, int(bound_index_type), (void*)offset, bound_base_vertex));
+    }
+
+    void Renderer::drawBoundMeshInstanced(unsigned count, unsigned base_instance) const
+    {
+        uintptr_t offset = uintptr_t(bound_first_index) * indexTypeSize(bound_index_type);
+
+        // instance buffers without buffer storage always start at instance 0, which gl 3.3 can draw
+        if(base_instance == 0 && !GLAD_GL_VERSION_4_2 && !GLAD_GL_ARB_base_instance)
+        {
+            glCall(glDrawElementsInstancedBaseVertex(int(draw_mode), bound_mesh_size, int(bound_index_type), (void*)offset,
+                                                     count, bound_base_vertex));
+        }
+        else
+        {
+            glCall(glDrawElementsInstancedBaseVertexBaseInstance(int(draw_mode), bound_mesh_size, int(bound_index_type), (void*)offset,
+                                                                  count, bound_base_vertex, base_instance));
+        }
+    }
+
+    void Renderer::drawIndirect(const DrawIndirectBuffer& buffer, unsigned draw_data_binding)
+    {
+        if(buffer.m_uploaded == 0) return;
+
+        bound_vao = buffer.m_vao;
+        bound_position_vao = buffer.m_position_vao;
+        bound_ibo = buffer.m_ibo;
+        bound_instance_mask = buffer.m_instance_mask;
+        bindVertexArrayInternal();
+        bound_mesh_size = 0;
+        bound_index_type = buffer.m_index_type;
+        bound_first_index = 0;
+        bound_base_vertex = 0;
+
+        if(buffer.m_draw_buffer)
+        {
+            glCall(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, draw_data_binding, buffer.m_draw_buffer));
+        }
+
+        glCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer.m_command_buffer));
+        glCall(glMultiDrawElementsIndirect(int(draw_mode), int(buffer.m_index_type), nullptr, buffer.m_uploaded, 0));
+        glCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
+    }
+
+    void Renderer::execute(const CommandList& commands)
+    {
+        commands.executeInternal(*this);
     }
 
     /////////////////////////////////////
@@ -89,7 +354,12 @@ namespace dgn
 
     void Renderer::setDepthTest(DepthTest func)
     {
-        glCall(glDepthFunc(GL_NEVER + int(func)));
+        syncStateInternal();
+
+        if(changeStateInternal(current_depth_func, unsigned(func)))
+        {
+            glCall(glDepthFunc(GL_NEVER + int(func)));
+        }
     }
 
     void Renderer::setClearColor(float red, float green, float blue)
@@ -109,33 +379,89 @@ namespace dgn
 
     void Renderer::setViewport(unsigned x, unsigned y, unsigned width, unsigned height)
     {
+        syncStateInternal();
+
+        unsigned viewport[4] = {x, y, width, height};
+        if(current_viewport[0] == x && current_viewport[1] == y && current_viewport[2] == width && current_viewport[3] == height)
+        {
+            state_stats.elided++;
+            return;
+        }
+
+        for(unsigned i = 0; i < 4; i++) current_viewport[i] = viewport[i];
+        state_stats.issued++;
+
         glCall(glViewport(x, y, width, height));
     }
 
     void Renderer::setCullFace(Face face)
     {
-        glCall(glCullFace(GL_FRONT + int(face)));
+        syncStateInternal();
+
+        if(changeStateInternal(current_cull_face, unsigned(face)))
+        {
+            glCall(glCullFace(GL_FRONT + int(face)));
+        }
     }
 
     void Renderer::setWinding(Winding winding)
     {
-        glCall(glFrontFace(GL_CW + int(winding)));
+        syncStateInternal();
+
+        if(changeStateInternal(current_winding, unsigned(winding)))
+        {
+            glCall(glFrontFace(GL_CW + int(winding)));
+        }
     }
 
     void Renderer::setAlphaBlend(AlphaFactor source_factor, AlphaFactor dest_factor)
     {
-        glBlendFunc(int(source_factor), int(dest_factor));
+        syncStateInternal();
+
+        if(current_blend[0] == unsigned(source_factor) && current_blend[1] == unsigned(dest_factor))
+        {
+            state_stats.elided++;
+            return;
+        }
+
+        current_blend[0] = unsigned(source_factor);
+        current_blend[1] = unsigned(dest_factor);
+        state_stats.issued++;
+
+        glCall(glBlendFunc(int(source_factor), int(dest_factor)));
     }
 
     void Renderer::setClipMode(ClipMode mode)
     {
-        glClipControl(GL_LOWER_LEFT, int(mode));
+        syncStateInternal();
+
+        if(changeStateInternal(current_clip_mode, unsigned(mode)))
+        {
+            glCall(glClipControl(GL_LOWER_LEFT, int(mode)));
+        }
     }
 
     /////////////////////////////////
     //            FLAGS            //
     /////////////////////////////////
 
+    static unsigned renderFlagIndex(RenderFlag flag)
+    {
+        switch(flag)
+        {
+        case RenderFlag::AlphaBlend:       return 0;
+        case RenderFlag::CullFace:         return 1;
+        case RenderFlag::DepthTest:        return 2;
+        case RenderFlag::MultiSampling:    return 3;
+        case RenderFlag::ScissorTest:      return 4;
+        case RenderFlag::StencilTest:      return 5;
+        case RenderFlag::SeamlessCubemaps: return 6;
+        case RenderFlag::LineSmoothing:    return 7;
+        }
+
+        return 0;
+    }
+
     void Renderer::enableClearFlag(ClearFlag flag)
     {
         clear_flags |= int(flag);
@@ -148,11 +474,21 @@ namespace dgn
 
     void Renderer::enableFlag(RenderFlag value)
     {
-        glCall(glEnable(int(value)));
+        syncStateInternal();
+
+        if(changeStateInternal(current_flags[renderFlagIndex(value)], 1))
+        {
+            glCall(glEnable(int(value)));
+        }
     }
 
     void Renderer::disableFlag(RenderFlag value)
     {
-        glCall(glDisable(int(value)));
+        syncStateInternal();
+
+        if(changeStateInternal(current_flags[renderFlagIndex(value)], 0))
+        {
+            glCall(glDisable(int(value)));
+        }
     }
 }
@@ -1,11 +1,12 @@
 #include "DragonEngine/Shader.h"
+#include "DragonEngine/Profiler.h"
 #include "d_internal.h"
 
 #include <glad/glad.h>
 
-#include <fstream>
-#include <iostream>
-#include <sstream>
+#include <algorithm>
+#include <string.h>
+#include <unordered_set>
 #include <vector>
 
 #include <m3d/vec2.h>
@@ -16,234 +17,913 @@
 
 namespace dgn
 {
-    std::string fileToString(std::string filepath);
-
     std::unordered_map<std::string, int> Shader::econst_ints;
 
-    Shader::Shader() : m_program(0) {}
+    Shader::Shader() : m_program(0), m_attrib_mask(0), m_fallback(nullptr) {}
     void Shader::dispose()
     {
+        discardPendingInternal();
         glCall(glDeleteProgram(m_program));
+        invalidateGLStateInternal();
     }
 
-    unsigned Shader::genShaderInternal(std::string data, GLenum shader_type)
+    ////////////////////////////////////////
+    //            PREPROCESSOR            //
+    ////////////////////////////////////////
+
+    static const unsigned MAX_INCLUDE_DEPTH = 32;
+
+    struct SourceFileInternal
     {
-        if(data.empty()) return 0;
+        int64_t time = 0;
+        uint64_t size = 0;
+        bool loaded = false;
+        std::string text;
+    };
 
-        std::istringstream stream(data);
-        std::vector<std::string> lines;
+    // Every shader file read, kept until its modification time or size changes, so reloading only reads edited files.
+    // Entries are never erased, pointers to their text stay valid.
+    static std::unordered_map<std::string, SourceFileInternal> s_source_cache;
 
-        size_t k = 0;
-        size_t j = 0;
-        std::string line;
-        while(std::getline(stream, line))
+    static const std::string* loadSourceInternal(const std::string& filepath)
+    {
+        int64_t time;
+        uint64_t size;
+        if(!fileStatInternal(filepath.c_str(), time, size))
         {
-            size_t p = line.find("#include");
+            logError("FILE LOADING", filepath.c_str());
+            return nullptr;
+        }
 
-            if(p != std::string::npos)
-            {
-                size_t n = line.find(" ");
-                std::string filepath = line.substr(n + 1);
+        SourceFileInternal& file = s_source_cache[filepath];
+        if(file.loaded && file.time == time && file.size == size) return &file.text;
 
-                std::string file_to_append = fileToString(filepath);
+        MappedFileInternal mapped;
+        if(mapFileInternal(filepath.c_str(), mapped))
+        {
+            file.text.assign((const char*)mapped.data, mapped.size);
+            unmapFileInternal(mapped);
+        }
+        else
+        {
+            // empty files can't be mapped
+            file.text.clear();
+        }
 
-                k = data.find("#include", k);
-                std::string first_half = data.substr(0, k);
-                k += line.length();
-                std::string second_half = file_to_append + data.substr(k);
+        file.time = time;
+        file.size = size;
+        file.loaded = true;
 
-                stream = std::istringstream(second_half);
+        return &file.text;
+    }
 
-                data = first_half;
-                data += second_half;
-            }
-            else
+    // State of one shader stage being expanded. Each file gets a source string number, #line directives
+    // around every include make the compiler report lines in the file they came from.
+    struct PreprocessInternal
+    {
+        std::string out;
+        std::vector<std::string> names;
+        std::vector<const std::string*> texts;
+        std::unordered_set<std::string> once;
+        const std::unordered_map<std::string, int> *econst_ints = nullptr;
+        unsigned depth = 0;
+    };
+
+    static bool isSpaceInternal(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    static size_t skipSpaceInternal(const std::string& text, size_t pos, size_t end)
+    {
+        while(pos < end && isSpaceInternal(text[pos])) pos++;
+        return pos;
+    }
+
+    static bool startsWithInternal(const std::string& text, size_t pos, size_t end, const char* word)
+    {
+        size_t length = strlen(word);
+        return end - pos >= length && text.compare(pos, length, word) == 0;
+    }
+
+    static size_t tokenEndInternal(const std::string& text, size_t pos, size_t end)
+    {
+        while(pos < end && !isSpaceInternal(text[pos]) && text[pos] != ';') pos++;
+        return pos;
+    }
+
+    // Copies text into pp.out line by line, one output line per input line so numbering only changes at includes
+    static void preprocessInternal(PreprocessInternal& pp, const std::string& text, unsigned source)
+    {
+        size_t pos = 0;
+        unsigned line = 1;
+
+        while(pos < text.size())
+        {
+            size_t end = text.find('\n', pos);
+            if(end == std::string::npos) end = text.size();
+
+            size_t p = skipSpaceInternal(text, pos, end);
+
+            if(startsWithInternal(text, p, end, "#include"))
             {
-                p = line.find("econst");
+                p = skipSpaceInternal(text, p + 8, end);
 
-                if(p != std::string::npos)
+                size_t q = end;
+                while(q > p && isSpaceInternal(text[q - 1])) q--;
+
+                // "path", <path> and a bare path are all accepted
+                if(q - p >= 2 && (text[p] == '"' || text[p] == '<'))
                 {
-                    size_t n = line.find(" ");
-                    size_t m = line.find(" ", n + 1);
-                    const char* type = line.substr(n + 1, m - n - 1).c_str();
-                    const char* name = line.substr(m + 1, line.length() - m - 2).c_str();
+                    p++;
+                    q--;
+                }
 
-                    j = data.find("econst", j);
-                    std::string first_half = data.substr(0, j);
-                    j += line.length();
-                    std::string second_half;
+                std::string filepath = text.substr(p, q - p);
+                const std::string *include = nullptr;
 
+                if(pp.once.count(filepath))
+                {
+                    // already expanded, nothing to add
+                }
+                else if(pp.depth >= MAX_INCLUDE_DEPTH)
+                {
+                    logError("SHADER INCLUDE", ("includes nested too deep, recursive include of " + filepath + "?").c_str());
+                }
+                else
+                {
+                    include = loadSourceInternal(filepath);
+                }
 
-                    if(type == std::string("int"))
-                    {
-                        auto v = Shader::econst_ints.find(name);
+                if(include)
+                {
+                    unsigned index = pp.names.size();
+                    pp.names.push_back(filepath);
+                    pp.texts.push_back(include);
+
+                    pp.out += "#line 1 " + std::to_string(index) + "\n";
 
-                        if(v != Shader::econst_ints.end())
-                        {
-                            int value = v->second;
+                    pp.depth++;
+                    preprocessInternal(pp, *include, index);
+                    pp.depth--;
 
-                            second_half = std::string("const int ") + name +
-                                        std::string(" = ") + std::to_string(value) + std::string(";") +
-                                        data.substr(j);
-                        }
-                    }
-                    stream = std::istringstream(second_half);
+                    pp.out += "#line " + std::to_string(line + 1) + " " + std::to_string(source) + "\n";
+                }
+                else
+                {
+                    pp.out += "\n";
+                }
+            }
+            else if(startsWithInternal(text, p, end, "#pragma") &&
+                    startsWithInternal(text, skipSpaceInternal(text, p + 7, end), end, "once"))
+            {
+                pp.once.insert(pp.names[source]);
+                pp.out += "\n";
+            }
+            else if(startsWithInternal(text, p, end, "econst") && p + 6 < end && isSpaceInternal(text[p + 6]))
+            {
+                // econst int NAME; becomes const int NAME = value; with the value given to setEconst
+                size_t type_begin = skipSpaceInternal(text, p + 6, end);
+                size_t type_end = tokenEndInternal(text, type_begin, end);
+                size_t name_begin = skipSpaceInternal(text, type_end, end);
+                size_t name_end = tokenEndInternal(text, name_begin, end);
 
-                    data = first_half;
-                    data += second_half;
+                std::string type = text.substr(type_begin, type_end - type_begin);
+                std::string name = text.substr(name_begin, name_end - name_begin);
 
+                auto v = pp.econst_ints->find(name);
+                if(type == "int" && v != pp.econst_ints->end())
+                {
+                    pp.out += "const int " + name + " = " + std::to_string(v->second) + ";\n";
                 }
                 else
                 {
-                    lines.push_back(line);
+                    logError("ECONST NOT SET", (type + " " + name).c_str());
+                    pp.out += "\n";
                 }
+            }
+            else
+            {
+                pp.out.append(text, pos, end - pos);
+                pp.out += "\n";
+            }
 
+            pos = end + 1;
+            line++;
+        }
+    }
+
+    static void logSourceLineInternal(const PreprocessInternal& pp, unsigned source, unsigned line_num)
+    {
+        const std::string& text = *pp.texts[source];
+
+        size_t pos = 0;
+        for(unsigned line = 1; pos < text.size(); line++)
+        {
+            size_t end = text.find('\n', pos);
+            if(end == std::string::npos) end = text.size();
+
+            if(line + 2 >= line_num && line <= line_num + 2)
+            {
+                logError((pp.names[source] + ":" + std::to_string(line)).c_str(), text.substr(pos, end - pos).c_str());
             }
+
+            if(line > line_num + 2) break;
+            pos = end + 1;
         }
+    }
+
+    // Finds the "source:line" every driver message points at, in the formats of Mesa, AMD, Intel and NVIDIA,
+    // and shows those lines from the file they belong to
+    static void logCompileErrorsInternal(const PreprocessInternal& pp, const std::string& log)
+    {
+        size_t pos = 0;
+        while(pos < log.size())
+        {
+            size_t end = log.find('\n', pos);
+            if(end == std::string::npos) end = log.size();
 
-        //longMessagef("%s\n", data.c_str());
+            std::string message = log.substr(pos, end - pos);
+            unsigned source, line;
 
-        const char* d = data.c_str();
+            if(sscanf(message.c_str(), "ERROR: %u:%u", &source, &line) == 2 ||
+               sscanf(message.c_str(), "WARNING: %u:%u", &source, &line) == 2 ||
+               sscanf(message.c_str(), "%u(%u)", &source, &line) == 2 ||
+               sscanf(message.c_str(), "%u:%u(", &source, &line) == 2)
+            {
+                if(source < pp.texts.size())
+                {
+                    logSourceLineInternal(pp, source, line);
+                }
+            }
+
+            pos = end + 1;
+        }
+    }
+
+    // Only starts the compile, the status is read in checkStageInternal so drivers can work on every stage at once
+    static unsigned startStageInternal(const PreprocessInternal& pp, GLenum shader_type)
+    {
+        const char* d = pp.out.c_str();
 
         glCall(unsigned shader = glCreateShader(shader_type));
         glCall(glShaderSource(shader, 1, &d, NULL));
         glCall(glCompileShader(shader));
 
+        return shader;
+    }
+
+    static void checkStageInternal(unsigned shader, const PreprocessInternal& pp)
+    {
         int success;
-        char buff[512];
         glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
         if(!success)
         {
-            glGetShaderInfoLog(shader, 512, NULL, buff);
-            logError("SHADER COMPILE STATUS", buff);
+            int length = 0;
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+
+            std::string log(length > 0 ? length : 1, '\0');
+            glGetShaderInfoLog(shader, log.size(), NULL, &log[0]);
+            log.resize(strlen(log.c_str()));
+
+            logError("SHADER COMPILE STATUS", (pp.names[0] + "\n" + log).c_str());
+            logCompileErrorsInternal(pp, log);
+        }
+    }
+
+    ////////////////////////////////////////
+    //           PROGRAM CACHE            //
+    ////////////////////////////////////////
+
+    /*
+        Program cache file layout, one file per key named after it:
+            ProgramCacheHeader
+            binary, binary_size bytes in binary_format
+    */
+    const uint32_t PROGRAM_CACHE_MAGIC   = 0x50474744; // "DGGP"
+    const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+    struct ProgramCacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t binary_format;
+        uint32_t binary_size;
+    };
+
+    std::string Shader::program_cache_dir;
+    static ProgramCacheStats s_program_cache_stats;
+
+    static void hashInternal(uint64_t& hash, const void* data, size_t size)
+    {
+        // FNV-1a
+        const unsigned char *p = (const unsigned char*)data;
+        for(size_t i = 0; i < size; i++)
+        {
+            hash ^= p[i];
+            hash *= 0x100000001B3ull;
+        }
+    }
+
+    static void hashStringInternal(uint64_t& hash, const char* str)
+    {
+        // the terminator keeps "ab" + "c" apart from "a" + "bc"
+        hashInternal(hash, str ? str : "", strlen(str ? str : "") + 1);
+    }
+
+    static uint64_t programKeyInternal(const PreprocessInternal pp[3], const std::unordered_map<std::string, int>& econst_ints)
+    {
+        uint64_t hash = 0xCBF29CE484222325ull;
+
+        for(int i = 0; i < 3; i++)
+        {
+            hashStringInternal(hash, pp[i].out.c_str());
+        }
+
+        // sorted, unordered_map iteration order is not stable between runs
+        std::vector<std::pair<std::string, int>> econsts(econst_ints.begin(), econst_ints.end());
+        std::sort(econsts.begin(), econsts.end());
+        for(const auto& econst : econsts)
+        {
+            hashStringInternal(hash, econst.first.c_str());
+            hashInternal(hash, &econst.second, sizeof(econst.second));
+        }
+
+        // a different driver or gpu can't load the binary, give it its own entry
+        glCall(hashStringInternal(hash, (const char*)glGetString(GL_VENDOR)));
+        glCall(hashStringInternal(hash, (const char*)glGetString(GL_RENDERER)));
+        glCall(hashStringInternal(hash, (const char*)glGetString(GL_VERSION)));
+
+        return hash;
+    }
+
+    static std::string programCachePathInternal(const std::string& dir, uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.dprog", (unsigned long long)key);
+
+        return dir + "/" + name;
+    }
+
+    static bool programBinariesSupportedInternal()
+    {
+        if(!GLAD_GL_ARB_get_program_binary) return false;
+
+        int formats = 0;
+        glCall(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats));
+        return formats > 0;
+    }
+
+    enum class ProgramCacheResultInternal
+    {
+        Missing,
+        Loaded,
+        // there was a binary, but corrupt or refused by the driver
+        Stale
+    };
+
+    static ProgramCacheResultInternal readProgramCacheInternal(unsigned program, const std::string& cache_path, uint64_t key)
+    {
+        MappedFileInternal file;
+        if(!mapFileInternal(cache_path.c_str(), file)) return ProgramCacheResultInternal::Missing;
+
+        ProgramCacheHeader header;
+        if(file.size < sizeof(header))
+        {
+            unmapFileInternal(file);
+            return ProgramCacheResultInternal::Stale;
+        }
+        memcpy(&header, file.data, sizeof(header));
+
+        if(header.magic != PROGRAM_CACHE_MAGIC || header.version != PROGRAM_CACHE_VERSION || header.key != key ||
+           file.size - sizeof(header) != header.binary_size)
+        {
+            logError("PROGRAM CACHE CORRUPT", cache_path.c_str());
+            unmapFileInternal(file);
+            return ProgramCacheResultInternal::Stale;
+        }
+
+        glCall(glProgramBinary(program, header.binary_format, file.data + sizeof(header), header.binary_size));
+        unmapFileInternal(file);
+
+        // drivers refuse binaries from another version without an error, only the link status tells
+        int success = 0;
+        glCall(glGetProgramiv(program, GL_LINK_STATUS, &success));
+        return success ? ProgramCacheResultInternal::Loaded : ProgramCacheResultInternal::Stale;
+    }
+
+    static void writeProgramCacheInternal(unsigned program, const std::string& cache_path, uint64_t key)
+    {
+        int length = 0;
+        glCall(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length));
+        if(length <= 0) return;
+
+        std::vector<unsigned char> binary(length);
+        unsigned format = 0;
+        glCall(glGetProgramBinary(program, length, &length, &format, binary.data()));
+
+        // write to a temporary file first so a failed write never leaves a valid looking cache
+        std::string temp_path = cache_path + ".tmp";
+        FILE *file = fopen(temp_path.c_str(), "wb");
+        if(!file)
+        {
+            logError("PROGRAM CACHE WRITING", cache_path.c_str());
+            return;
+        }
+
+        ProgramCacheHeader header = {};
+        header.magic = PROGRAM_CACHE_MAGIC;
+        header.version = PROGRAM_CACHE_VERSION;
+        header.key = key;
+        header.binary_format = format;
+        header.binary_size = length;
+
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = ok && fwrite(binary.data(), 1, length, file) == size_t(length);
+        ok = (fclose(file) == 0) && ok;
+
+        remove(cache_path.c_str());
+        if(!ok || rename(temp_path.c_str(), cache_path.c_str()) != 0)
+        {
+            remove(temp_path.c_str());
+            logError("PROGRAM CACHE WRITING", cache_path.c_str());
+        }
+    }
+
+    ////////////////////////////////////////
+    //              LINKING               //
+    ////////////////////////////////////////
+
+    // A program from the moment its stages are handed to the driver until it is checked and reflected
+    struct Shader::PendingProgramInternal
+    {
+        std::string code[3];
+        PreprocessInternal pp[3];
 
-            std::string buff_s = buff;
+        unsigned program = 0;
+        unsigned stages[3] = {};
+        bool from_cache = false;
 
-            size_t debug_v = buff_s.find("ERROR: ");
-            size_t total_line_num = lines.size();
+        bool use_cache = false;
+        uint64_t key = 0;
+        std::string cache_path;
+    };
 
-            while((debug_v != std::string::npos))
+    // Lets the driver compile on its own threads, asked once per run
+    static bool parallelCompileInternal()
+    {
+        static int s_parallel = -1;
+
+        if(s_parallel < 0)
+        {
+            s_parallel = 0;
+
+            if(GLAD_GL_KHR_parallel_shader_compile)
+            {
+                glCall(glMaxShaderCompilerThreadsKHR(0xFFFFFFFF));
+                s_parallel = 1;
+            }
+            else if(GLAD_GL_ARB_parallel_shader_compile)
             {
-                debug_v = buff_s.find(":", debug_v + 7) + 1;
-                std::string line_s = buff_s.substr(debug_v);
-                size_t debug_n = line_s.find(":");
-                int line_num = std::stoi(line_s.substr(0, debug_n));
+                glCall(glMaxShaderCompilerThreadsARB(0xFFFFFFFF));
+                s_parallel = 1;
+            }
+        }
 
-                for(int i = -2; i < 3; i++)
-                {
-                    int line = line_num + i;
-
-                    if(line > 0)
-                    {
-                        if(unsigned(line) < total_line_num)
-                        {
-                            logError(std::to_string(line).c_str(), lines[line - 1].c_str());
-                        }
-                    }
-                }
+        return s_parallel == 1;
+    }
+
+    static void readStagesInternal(const std::string paths[3], std::string code[3])
+    {
+        for(int i = 0; i < 3; i++)
+        {
+            if(paths[i].empty()) continue;
+
+            const std::string *text = loadSourceInternal(paths[i]);
+            if(text) code[i] = *text;
+        }
+    }
 
-                debug_v = buff_s.find("ERROR: ", debug_v);
+    void Shader::beginInternal(const std::string code[3], const std::string names[3])
+    {
+        static const GLenum STAGE_TYPES[3] = {GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER};
+
+        discardPendingInternal();
+        parallelCompileInternal();
+
+        m_pending = std::make_shared<PendingProgramInternal>();
+        PendingProgramInternal& p = *m_pending;
+
+        for(int i = 0; i < 3; i++)
+        {
+            if(code[i].empty()) continue;
+
+            // owned by the pending program, error reports point into it after the caller's strings are gone
+            p.code[i] = code[i];
+
+            p.pp[i].out.reserve(code[i].size() * 2);
+            p.pp[i].names.push_back(names[i]);
+            p.pp[i].texts.push_back(&p.code[i]);
+            p.pp[i].econst_ints = &econst_ints;
+
+            preprocessInternal(p.pp[i], p.code[i], 0);
+        }
+
+        p.use_cache = !program_cache_dir.empty() && programBinariesSupportedInternal();
+
+        if(p.use_cache)
+        {
+            p.key = programKeyInternal(p.pp, econst_ints);
+            p.cache_path = programCachePathInternal(program_cache_dir, p.key);
+
+            glCall(p.program = glCreateProgram());
+
+            ProgramCacheResultInternal result = readProgramCacheInternal(p.program, p.cache_path, p.key);
+            if(result == ProgramCacheResultInternal::Loaded)
+            {
+                s_program_cache_stats.hits++;
+                p.from_cache = true;
+                return;
             }
 
+            if(result == ProgramCacheResultInternal::Stale)
+            {
+                s_program_cache_stats.stale++;
+            }
+            else
+            {
+                s_program_cache_stats.misses++;
+            }
+
+            glCall(glDeleteProgram(p.program));
         }
 
-        return shader;
+        glCall(p.program = glCreateProgram());
+
+        for(int i = 0; i < 3; i++)
+        {
+            if(p.pp[i].out.empty()) continue;
+
+            p.stages[i] = startStageInternal(p.pp[i], STAGE_TYPES[i]);
+            glCall(glAttachShader(p.program, p.stages[i]));
+        }
+
+        if(p.use_cache)
+        {
+            glCall(glProgramParameteri(p.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+        }
+
+        glCall(glLinkProgram(p.program));
     }
 
-    Shader& Shader::createFromData(std::string vertex_code, std::string geometry_code, std::string fragment_code)
+    void Shader::discardPendingInternal()
     {
-        glCall(unsigned program = glCreateProgram());
+        if(!m_pending) return;
+
+        for(int i = 0; i < 3; i++)
+        {
+            if(m_pending->stages[i])
+            {
+                glCall(glDeleteShader(m_pending->stages[i]));
+            }
+        }
+
+        glCall(glDeleteProgram(m_pending->program));
+        m_pending.reset();
+    }
+
+    void Shader::finishInternal()
+    {
+        // reading any status waits for the driver to finish the program
+        PendingProgramInternal& p = *m_pending;
+        unsigned program = p.program;
+
+        if(!p.from_cache)
+        {
+            for(int i = 0; i < 3; i++)
+            {
+                if(p.stages[i])
+                {
+                    checkStageInternal(p.stages[i], p.pp[i]);
+                }
+            }
 
-        unsigned vertex   = genShaderInternal(vertex_code, GL_VERTEX_SHADER);
-        unsigned geometry = genShaderInternal(geometry_code, GL_GEOMETRY_SHADER);
-        unsigned fragment = genShaderInternal(fragment_code, GL_FRAGMENT_SHADER);
+            for(int i = 0; i < 3; i++)
+            {
+                if(p.stages[i])
+                {
+                    glCall(glDeleteShader(p.stages[i]));
+                }
+            }
+
+            int success;
+            glGetProgramiv(program, GL_LINK_STATUS, &success);
+            if(!success)
+            {
+                char buff[512];
+                glGetProgramInfoLog(program, sizeof(buff), NULL, buff);
+                logError("SHADER LINKING STATUS", buff);
+
+                // a broken reload keeps the working program, its uniforms and attributes
+                glCall(glDeleteProgram(program));
+                m_pending.reset();
+                return;
+            }
+
+            if(p.use_cache)
+            {
+                writeProgramCacheInternal(program, p.cache_path, p.key);
+            }
+        }
+
+        m_pending.reset();
 
-        if(vertex != 0)
+        if(m_program)
         {
-            glCall(glAttachShader(program, vertex));
+            glCall(glDeleteProgram(m_program));
         }
 
-        if(geometry != 0)
+        m_program = program;
+        invalidateGLStateInternal();
+        m_attrib_mask = 0;
+
+        reflectInternal();
+
+        int attrib_count = 0;
+        glCall(glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &attrib_count));
+
+        for(int i = 0; i < attrib_count; i++)
         {
-            glCall(glAttachShader(program, geometry));
+            char name[128];
+            int size;
+            unsigned type;
+            glCall(glGetActiveAttrib(program, i, sizeof(name), nullptr, &size, &type, name));
+            glCall(int loc = glGetAttribLocation(program, name));
+
+            // built in inputs like gl_VertexID have no location
+            if(loc >= 0 && loc < 32)
+            {
+                m_attrib_mask |= 1u << loc;
+            }
         }
 
-        if(fragment != 0)
+        for(const auto& block : m_block_bindings)
         {
-            glCall(glAttachShader(program, fragment));
+            bindUniformBlockInternal(block.first, block.second);
         }
+    }
 
-        glCall(glLinkProgram(program));
+    Shader& Shader::linkInternal(const std::string code[3], const std::string names[3])
+    {
+        beginInternal(code, names);
+        finishInternal();
 
-        #ifdef __DEBUG__
-        int success;
-        char buff[256];
-        glGetProgramiv(program, GL_LINK_STATUS, &success);
-        if(!success)
+        return *this;
+    }
+
+    Shader& Shader::createFromData(std::string vertex_code, std::string geometry_code, std::string fragment_code)
+    {
+        const std::string code[3] = {vertex_code, geometry_code, fragment_code};
+        const std::string names[3] = {"vertex", "geometry", "fragment"};
+
+        return linkInternal(code, names);
+    }
+
+    Shader& Shader::createFromDataAsync(std::string vertex_code, std::string geometry_code, std::string fragment_code)
+    {
+        const std::string code[3] = {vertex_code, geometry_code, fragment_code};
+        const std::string names[3] = {"vertex", "geometry", "fragment"};
+
+        beginInternal(code, names);
+        return *this;
+    }
+
+    Shader& Shader::loadFromFiles(std::string vertex_path, std::string geometry_path, std::string fragment_path)
+    {
+        DGN_PROFILE_SCOPE("ShaderLoad");
+
+        const std::string names[3] = {vertex_path, geometry_path, fragment_path};
+        std::string code[3];
+        readStagesInternal(names, code);
+
+        return linkInternal(code, names);
+    }
+
+    Shader& Shader::loadFromFilesAsync(std::string vertex_path, std::string geometry_path, std::string fragment_path)
+    {
+        DGN_PROFILE_SCOPE("ShaderLoad");
+
+        const std::string names[3] = {vertex_path, geometry_path, fragment_path};
+        std::string code[3];
+        readStagesInternal(names, code);
+
+        beginInternal(code, names);
+        return *this;
+    }
+
+    bool Shader::isReady()
+    {
+        if(!m_pending) return true;
+
+        // without the extension there is no way to ask, so the program is finished here
+        if(parallelCompileInternal())
         {
-            glGetProgramInfoLog(program, 256, NULL, buff);
-            logError("SHADER LINKING STATUS", buff);
+            int done = 0;
+            glCall(glGetProgramiv(m_pending->program, GL_COMPLETION_STATUS_KHR, &done));
+            if(!done) return false;
         }
-        #endif // __DEBUG
 
-        glCall(glDeleteShader(vertex));
-        glCall(glDeleteShader(geometry));
-        glCall(glDeleteShader(fragment));
+        DGN_PROFILE_SCOPE("ShaderFinish");
+        finishInternal();
+        return true;
+    }
 
-        m_program = program;
+    Shader& Shader::finish()
+    {
+        if(m_pending)
+        {
+            DGN_PROFILE_SCOPE("ShaderFinish");
+            finishInternal();
+        }
 
         return *this;
     }
 
-    std::string fileToString(std::string filepath)
+    Shader& Shader::setFallback(Shader* fallback)
     {
-        if(filepath.empty()) return "";
+        m_fallback = fallback;
+        return *this;
+    }
 
-        std::ifstream file;
-        file.open(filepath.c_str());
+    const Shader& Shader::getActive() const
+    {
+        // a reloading shader keeps its previous program until the new one is ready
+        if(m_program != 0 || !m_fallback) return *this;
 
-        if(!file.is_open())
+        return m_fallback->getActive();
+    }
+
+    static bool hashLessInternal(const std::pair<uint32_t, unsigned>& a, const std::pair<uint32_t, unsigned>& b)
+    {
+        return a.first < b.first;
+    }
+
+    static const std::pair<uint32_t, unsigned>* findHashInternal(const std::vector<std::pair<uint32_t, unsigned>>& table, uint32_t hash)
+    {
+        auto it = std::lower_bound(table.begin(), table.end(), std::make_pair(hash, 0u), hashLessInternal);
+        if(it == table.end() || it->first != hash) return nullptr;
+
+        return &*it;
+    }
+
+    static void checkCollisionsInternal(const std::vector<std::pair<uint32_t, unsigned>>& table, const char* what)
+    {
+        for(size_t i = 1; i < table.size(); i++)
         {
-            logError("FILE LOADING", filepath.c_str());
-            return "";
+            // the same uniform is listed under name and name[0], only different entries collide
+            if(table[i].first == table[i - 1].first && table[i].second != table[i - 1].second)
+            {
+                logError("UNIFORM HASH COLLISION", what);
+            }
         }
+    }
+
+    void Shader::reflectInternal()
+    {
+        m_uniforms.clear();
+        m_uniform_lookup.clear();
+        m_blocks.clear();
 
-        std::string res;
+        int count = 0;
+        int max_length = 0;
+        glCall(glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &count));
+        glCall(glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length));
 
-        char line[512];
+        std::vector<char> buffer(max_length + 1);
 
-        while(!file.eof())
+        for(int i = 0; i < count; i++)
         {
-            file.getline(line, 512);
+            int size;
+            unsigned type;
+            glCall(glGetActiveUniform(m_program, i, buffer.size(), nullptr, &size, &type, buffer.data()));
+
+            std::string name = buffer.data();
+            bool is_array = name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0;
+            if(is_array) name.resize(name.size() - 3);
+
+            for(int e = 0; e < size; e++)
+            {
+                std::string element = is_array ? name + "[" + std::to_string(e) + "]" : name;
+
+                // members of uniform blocks have no location
+                glCall(int location = glGetUniformLocation(m_program, element.c_str()));
+                if(location < 0) break;
+
+                UniformInternal uniform;
+                uniform.location = location;
+                uniform.remaining = size - 1 - e;
+                uniform.value_size = 0;
 
-            res += line;
-            res += "\n";
+                unsigned index = m_uniforms.size();
+                m_uniforms.push_back(uniform);
+
+                m_uniform_lookup.push_back(std::make_pair(hashUniformName(element.c_str(), element.size()), index));
+                if(is_array && e == 0)
+                {
+                    m_uniform_lookup.push_back(std::make_pair(hashUniformName(name.c_str(), name.size()), index));
+                }
+            }
         }
 
-        file.close();
+        std::sort(m_uniform_lookup.begin(), m_uniform_lookup.end());
+        checkCollisionsInternal(m_uniform_lookup, "two uniform names share a hash, rename one");
+
+        glCall(glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_BLOCKS, &count));
+        glCall(glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_length));
+
+        buffer.resize(max_length + 1);
+
+        for(int i = 0; i < count; i++)
+        {
+            int length = 0;
+            glCall(glGetActiveUniformBlockName(m_program, i, buffer.size(), &length, buffer.data()));
+            m_blocks.push_back(std::make_pair(hashUniformName(buffer.data(), length), unsigned(i)));
+        }
 
-        return res;
+        std::sort(m_blocks.begin(), m_blocks.end());
+        checkCollisionsInternal(m_blocks, "two uniform block names share a hash, rename one");
     }
 
-    Shader& Shader::loadFromFiles(std::string vertex_path, std::string geometry_path, std::string fragment_path)
+    int Shader::getUniformLocation(const std::string& name) const
+    {
+        const std::pair<uint32_t, unsigned> *entry = findHashInternal(m_uniform_lookup, hashUniformName(name.c_str(), name.size()));
+
+        if(!entry)
+        {
+            logError("UNIFORM NOT FOUND", name.c_str());
+            return -1;
+        }
+
+        return m_uniforms[entry->second].location;
+    }
+
+    Shader::UniformInternal* Shader::findUniformInternal(UniformHandle handle)
     {
-        std::string v_code = fileToString(vertex_path);
-        std::string g_code = fileToString(geometry_path);
-        std::string f_code = fileToString(fragment_path);
+        const std::pair<uint32_t, unsigned> *entry = findHashInternal(m_uniform_lookup, handle.hash);
+        if(!entry) return nullptr;
+
+        UniformInternal *uniform = &m_uniforms[entry->second];
+        if(handle.index > uniform->remaining) return nullptr;
 
-        return createFromData(v_code, g_code, f_code);
+        return uniform + handle.index;
     }
 
-    int Shader::getUniformLocation(std::string name) const
+    int Shader::cacheUniformInternal(UniformHandle handle, const void* value, unsigned size)
     {
-        glCall(int loc = glGetUniformLocation(m_program, name.c_str()));
+        // the fallback is the program bound in this shader's place
+        if(!m_program && m_fallback) return m_fallback->cacheUniformInternal(handle, value, size);
+
+        UniformInternal *uniform = findUniformInternal(handle);
+        if(!uniform) return -1;
 
-        if(loc == -1)
+        if(uniform->value_size == size && memcmp(uniform->value, value, size) == 0) return -1;
+
+        memcpy(uniform->value, value, size);
+        uniform->value_size = size;
+
+        return uniform->location;
+    }
+
+    unsigned Shader::getAttribMask() const
+    {
+        return m_attrib_mask;
+    }
+
+    void Shader::bindUniformBlockInternal(const std::string& name, unsigned binding)
+    {
+        const std::pair<uint32_t, unsigned> *entry = findHashInternal(m_blocks, hashUniformName(name.c_str(), name.size()));
+
+        if(!entry)
         {
-            logError("UNIFORM NOT FOUND", name.c_str());
+            logError("UNIFORM BLOCK NOT FOUND", name.c_str());
+            return;
         }
 
-        return loc;
+        glCall(glUniformBlockBinding(m_program, entry->second, binding));
+    }
+
+    Shader& Shader::bindUniformBlock(std::string name, unsigned binding)
+    {
+        m_block_bindings[name] = binding;
+
+        // a program still compiling gets its bindings once it is finished
+        if(m_program)
+        {
+            bindUniformBlockInternal(name, binding);
+        }
+
+        return *this;
     }
 
     void Shader::uniform(int loc, float value)
@@ -286,10 +966,90 @@ namespace dgn
         glCall(glUniformMatrix4fv(loc, 1, GL_TRUE, value.m[0]));
     }
 
+    void Shader::uniform(UniformHandle handle, float value)
+    {
+        int loc = cacheUniformInternal(handle, &value, sizeof(value));
+        if(loc < 0) return;
+
+        glCall(glUniform1f(loc, value));
+    }
+
+    void Shader::uniform(UniformHandle handle, int value)
+    {
+        int loc = cacheUniformInternal(handle, &value, sizeof(value));
+        if(loc < 0) return;
+
+        glCall(glUniform1i(loc, value));
+    }
+
+    void Shader::uniform(UniformHandle handle, bool value)
+    {
+        uniform(handle, int(value));
+    }
+
+    void Shader::uniform(UniformHandle handle, const m3d::vec2& value)
+    {
+        float v[2] = {value.x, value.y};
+        int loc = cacheUniformInternal(handle, v, sizeof(v));
+        if(loc < 0) return;
+
+        glCall(glUniform2fv(loc, 1, v));
+    }
+
+    void Shader::uniform(UniformHandle handle, const m3d::vec3& value)
+    {
+        float v[3] = {value.x, value.y, value.z};
+        int loc = cacheUniformInternal(handle, v, sizeof(v));
+        if(loc < 0) return;
+
+        glCall(glUniform3fv(loc, 1, v));
+    }
+
+    void Shader::uniform(UniformHandle handle, const m3d::vec4& value)
+    {
+        float v[4] = {value.x, value.y, value.z, value.w};
+        int loc = cacheUniformInternal(handle, v, sizeof(v));
+        if(loc < 0) return;
+
+        glCall(glUniform4fv(loc, 1, v));
+    }
+
+    void Shader::uniform(UniformHandle handle, const m3d::mat3x3& value)
+    {
+        int loc = cacheUniformInternal(handle, value.m[0], sizeof(float) * 9);
+        if(loc < 0) return;
+
+        glCall(glUniformMatrix3fv(loc, 1, GL_TRUE, value.m[0]));
+    }
+
+    void Shader::uniform(UniformHandle handle, const m3d::mat4x4& value)
+    {
+        int loc = cacheUniformInternal(handle, value.m[0], sizeof(float) * 16);
+        if(loc < 0) return;
+
+        glCall(glUniformMatrix4fv(loc, 1, GL_TRUE, value.m[0]));
+    }
+
     void Shader::setEconst(std::string name, int value)
     {
         econst_ints[name] = value;
     }
+
+    void Shader::setProgramCacheDir(std::string dir)
+    {
+        if(!dir.empty() && !makeDirectoryInternal(dir.c_str()))
+        {
+            logError("PROGRAM CACHE DIRECTORY", dir.c_str());
+            dir.clear();
+        }
+
+        program_cache_dir = dir;
+    }
+
+    ProgramCacheStats Shader::getProgramCacheStats()
+    {
+        return s_program_cache_stats;
+    }
 }
 
 
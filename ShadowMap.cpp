@@ -1,4 +1,8 @@
 #include "DragonEngine/ShadowMap.h"
+#include "DragonEngine/Profiler.h"
+#include "d_internal.h"
+
+#include <glad/glad.h>
 
 #include <m3d/quat.h>
 #include <m3d/vec4.h>
@@ -47,8 +51,13 @@ namespace dgn
         return *this;
     }
 
-    ShadowMap& ShadowMap::updateProjectionMatFitted(Camera cam, float near, float far, float near_pull, float scale_value)
+    // Bounding sphere of the camera slice in light space, snapped to whole texels so the projection
+    // neither shimmers when the camera turns nor when it moves
+    static m3d::mat4x4 fitProjectionInternal(Camera& cam, const m3d::mat4x4& light_view, unsigned width, unsigned height,
+                                             float near, float far, float near_pull, float scale_value)
     {
+        DGN_PROFILE_SCOPE("ShadowFit");
+
         float ratio = cam.width / cam.height;
         float tanHalfHFOV = tanf(cam.fov * ratio / 2.0f);
         float tanHalfVFOV = tanf(cam.fov / 2.0f);
@@ -122,8 +131,8 @@ namespace dgn
 
         /** -- Position shimmering -- **/
         float rx2 = sphere.radius * 2.0f;
-        m3d::vec3 texel_world_size = m3d::vec3(rx2 / m_texture.getWidth(),
-                                rx2 / m_texture.getHeight(), 1.0f);
+        m3d::vec3 texel_world_size = m3d::vec3(rx2 / width,
+                                rx2 / height, 1.0f);
 
         sphere.center = m3d::vec3::invScale(sphere.center, texel_world_size);
 
@@ -135,16 +144,21 @@ namespace dgn
         m3d::vec3 max = sphere.center + m3d::vec3(sphere.radius);
         m3d::vec3 min = sphere.center - m3d::vec3(sphere.radius);
 
-        m_projection = m3d::mat4x4::initOrtho(max.x, min.x, max.y, min.y, min.z - near_pull, max.z);
+        return m3d::mat4x4::initOrtho(max.x, min.x, max.y, min.y, min.z - near_pull, max.z);
+    }
+
+    ShadowMap& ShadowMap::updateProjectionMatFitted(Camera cam, float near, float far, float near_pull, float scale_value)
+    {
+        m_projection = fitProjectionInternal(cam, light_view, m_texture.getWidth(), m_texture.getHeight(), near, far, near_pull, scale_value);
         return *this;
     }
 
-    Framebuffer ShadowMap::getFramebuffer()
+    const Framebuffer& ShadowMap::getFramebuffer() const
     {
         return m_buffer;
     }
 
-    Texture ShadowMap::getTexture()
+    const Texture& ShadowMap::getTexture() const
     {
         return m_texture;
     }
@@ -153,4 +167,281 @@ namespace dgn
     {
         return m_projection * light_view;
     }
+
+    // Transforms four points given as a structure of arrays, w = 1
+    static void transformPoints4Internal(const m3d::mat4x4& mat, const float x[4], const float y[4], const float z[4],
+                                         float out_x[4], float out_y[4], float out_z[4])
+    {
+#ifdef DGN_SSE
+        __m128 px = _mm_loadu_ps(x);
+        __m128 py = _mm_loadu_ps(y);
+        __m128 pz = _mm_loadu_ps(z);
+
+        float *out[3] = {out_x, out_y, out_z};
+        for(int r = 0; r < 3; r++)
+        {
+            __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(mat.m[r][0]), px), _mm_mul_ps(_mm_set1_ps(mat.m[r][1]), py)),
+                                  _mm_add_ps(_mm_mul_ps(_mm_set1_ps(mat.m[r][2]), pz), _mm_set1_ps(mat.m[r][3])));
+            _mm_storeu_ps(out[r], v);
+        }
+#else
+        for(int i = 0; i < 4; i++)
+        {
+            out_x[i] = mat.m[0][0] * x[i] + mat.m[0][1] * y[i] + mat.m[0][2] * z[i] + mat.m[0][3];
+            out_y[i] = mat.m[1][0] * x[i] + mat.m[1][1] * y[i] + mat.m[1][2] * z[i] + mat.m[1][3];
+            out_z[i] = mat.m[2][0] * x[i] + mat.m[2][1] * y[i] + mat.m[2][2] * z[i] + mat.m[2][3];
+        }
+#endif
+    }
+
+    Frustum ShadowMap::getFrustum() const
+    {
+        return Frustum::fromMatrix(m_projection * light_view);
+    }
+
+    ////////////////////////////////////////
+    //             CASCADED               //
+    ////////////////////////////////////////
+
+    CascadedShadowMap::CascadedShadowMap() : m_texture(), m_buffer(), light_view(1.0f), m_frame(0), m_render_mask(0), m_skipped(0) {}
+
+    CascadedShadowMap& CascadedShadowMap::initialize(unsigned width, unsigned height, unsigned cascades)
+    {
+        m_texture.createAs2DArray(nullptr, dgn::TextureData::Float, width, height, cascades, dgn::TextureWrap::ClampToBorder,
+                                  dgn::TextureFilter::Bilinear, dgn::TextureStorage::Depth, dgn::TextureStorage::Depth);
+
+        // the texture setters work on the texture bound in slot 0
+        glCall(glActiveTexture(GL_TEXTURE0));
+        glCall(glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture.getNativeTexture()));
+        m_texture.setBorderColor(1.0f, 1.0f, 1.0f, 1.0f).setDepthCompare(true);
+        glCall(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+
+        m_buffer.create();
+        m_buffer.setDepthAttachmentLayered(m_texture);
+        m_buffer.complete();
+
+        m_cascades.resize(cascades);
+        for(unsigned i = 0; i < cascades; i++)
+        {
+            Cascade& cascade = m_cascades[i];
+            cascade.projection = m3d::mat4x4(1.0f);
+            cascade.rendered_light_mat = m3d::mat4x4(1.0f);
+            cascade.interval = 1;
+            cascade.valid = false;
+
+            cascade.layer_buffer.create();
+            cascade.layer_buffer.setDepthAttachment(m_texture, i, 0);
+            cascade.layer_buffer.complete();
+        }
+
+        m_frame = 0;
+        m_render_mask = 0;
+        m_skipped = 0;
+
+        return *this;
+    }
+
+    void CascadedShadowMap::dispose()
+    {
+        for(Cascade& cascade : m_cascades)
+        {
+            cascade.layer_buffer.dispose();
+        }
+        m_cascades.clear();
+
+        m_buffer.dispose();
+        m_texture.dispose();
+    }
+
+    CascadedShadowMap& CascadedShadowMap::updateViewMat(const m3d::vec3& dir)
+    {
+        m3d::quat light_quat = m3d::quat::face(dir, m3d::vec3(0.0f, 1.0f, 0.0f));
+        light_view.rotate(-light_quat);
+
+        return *this;
+    }
+
+    CascadedShadowMap& CascadedShadowMap::updateProjectionMatFitted(unsigned cascade, Camera cam, float near, float far, float near_pull, float scale_value)
+    {
+        if(cascade >= m_cascades.size())
+        {
+            logError("CASCADED SHADOW MAP", "cascade out of range");
+            return *this;
+        }
+
+        m_cascades[cascade].projection = fitProjectionInternal(cam, light_view, m_texture.getWidth(), m_texture.getHeight(), near, far, near_pull, scale_value);
+        return *this;
+    }
+
+    CascadedShadowMap& CascadedShadowMap::updateProjectionMatsFitted(const Camera& cam, const float *distances, float near_pull, float scale_value)
+    {
+        DGN_PROFILE_SCOPE("ShadowFit");
+
+        float ratio = cam.width / cam.height;
+        float tanHalfHFOV = tanf(cam.fov * ratio / 2.0f);
+        float tanHalfVFOV = tanf(cam.fov / 2.0f);
+
+        // light_view is a rotation, so distances can be measured in view space and only the centers moved to light space
+        m3d::mat4x4 view_to_light = light_view * cam.getInverseView();
+
+        float width = m_texture.getWidth();
+        float height = m_texture.getHeight();
+
+        unsigned count = m_cascades.size();
+        for(unsigned first = 0; first < count; first += 4)
+        {
+            // A slice is symmetric around the view axis, so its corners average to a point on it. The two
+            // longest corner distances are the far diagonal and near to opposite far corner, the rest are shorter.
+            float axis_x[4] = {}, axis_y[4] = {}, axis_z[4] = {};
+            float diameter[4] = {};
+
+            for(unsigned l = 0; l < 4 && first + l < count; l++)
+            {
+                float near = distances[first + l];
+                float far = distances[first + l + 1];
+
+                float near_x = near * tanHalfHFOV, near_y = near * tanHalfVFOV;
+                float far_x = far * tanHalfHFOV, far_y = far * tanHalfVFOV;
+
+                float far_diagonal = 2.0f * std::sqrt(far_x * far_x + far_y * far_y);
+                float across = std::sqrt((near_x + far_x) * (near_x + far_x) + (near_y + far_y) * (near_y + far_y) + (far - near) * (far - near));
+
+                axis_z[l] = -(near + far) / 2.0f;
+                diameter[l] = std::max(far_diagonal, across);
+            }
+
+            float center_x[4], center_y[4], center_z[4];
+            transformPoints4Internal(view_to_light, axis_x, axis_y, axis_z, center_x, center_y, center_z);
+
+            for(unsigned l = 0; l < 4 && first + l < count; l++)
+            {
+                float radius = diameter[l] / 2.0f * scale_value;
+
+                // snapped to whole texels like the single fit, against position shimmering
+                float texel_x = radius * 2.0f / width;
+                float texel_y = radius * 2.0f / height;
+
+                m3d::vec3 center = m3d::vec3(std::floor(center_x[l] / texel_x) * texel_x,
+                                             std::floor(center_y[l] / texel_y) * texel_y,
+                                             center_z[l]);
+
+                m3d::vec3 max = center + m3d::vec3(radius);
+                m3d::vec3 min = center - m3d::vec3(radius);
+
+                m_cascades[first + l].projection = m3d::mat4x4::initOrtho(max.x, min.x, max.y, min.y, min.z - near_pull, max.z);
+            }
+        }
+
+        return *this;
+    }
+
+    CascadedShadowMap& CascadedShadowMap::setUpdateInterval(unsigned cascade, unsigned frames)
+    {
+        if(cascade >= m_cascades.size())
+        {
+            logError("CASCADED SHADOW MAP", "cascade out of range");
+            return *this;
+        }
+
+        m_cascades[cascade].interval = frames ? frames : 1;
+        return *this;
+    }
+
+    CascadedShadowMap& CascadedShadowMap::invalidate()
+    {
+        for(Cascade& cascade : m_cascades)
+        {
+            cascade.valid = false;
+        }
+
+        return *this;
+    }
+
+    // the projections are snapped to texels, so an unchanged cascade gives the exact same floats
+    static bool sameMatrixInternal(const m3d::mat4x4& a, const m3d::mat4x4& b)
+    {
+        for(int r = 0; r < 4; r++)
+        {
+            for(int c = 0; c < 4; c++)
+            {
+                if(a.m[r][c] != b.m[r][c]) return false;
+            }
+        }
+
+        return true;
+    }
+
+    unsigned CascadedShadowMap::selectCascades()
+    {
+        m_render_mask = 0;
+
+        for(unsigned i = 0; i < m_cascades.size(); i++)
+        {
+            Cascade& cascade = m_cascades[i];
+            m3d::mat4x4 light_mat = cascade.projection * light_view;
+
+            bool due = (m_frame + i) % cascade.interval == 0;
+            bool changed = !cascade.valid || !sameMatrixInternal(light_mat, cascade.rendered_light_mat);
+
+            // a layer never rendered has nothing to fall back on, so it skips the cadence
+            if(!cascade.valid || (due && changed))
+            {
+                cascade.rendered_light_mat = light_mat;
+                cascade.valid = true;
+                m_render_mask |= 1u << i;
+            }
+            else
+            {
+                m_skipped++;
+            }
+        }
+
+        m_frame++;
+        return m_render_mask;
+    }
+
+    unsigned CascadedShadowMap::getRenderMask() const
+    {
+        return m_render_mask;
+    }
+
+    unsigned CascadedShadowMap::getSkippedRenders() const
+    {
+        return m_skipped;
+    }
+
+    void CascadedShadowMap::resetSkippedRenders()
+    {
+        m_skipped = 0;
+    }
+
+    const Framebuffer& CascadedShadowMap::getFramebuffer() const
+    {
+        return m_buffer;
+    }
+
+    const Framebuffer& CascadedShadowMap::getLayerFramebuffer(unsigned cascade) const
+    {
+        return m_cascades[cascade].layer_buffer;
+    }
+
+    const Texture& CascadedShadowMap::getTexture() const
+    {
+        return m_texture;
+    }
+
+    unsigned CascadedShadowMap::getCascadeCount() const
+    {
+        return m_cascades.size();
+    }
+
+    m3d::mat4x4 CascadedShadowMap::getLightMat(unsigned cascade) const
+    {
+        return m_cascades[cascade].rendered_light_mat;
+    }
+
+    Frustum CascadedShadowMap::getFrustum(unsigned cascade) const
+    {
+        return Frustum::fromMatrix(m_cascades[cascade].projection * light_view);
+    }
 }
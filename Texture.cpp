@@ -1,4 +1,5 @@
 #include "DragonEngine/Texture.h"
+#include "DragonEngine/Profiler.h"
 #include "d_internal.h"
 
 #include "lodepng.h"
@@ -17,6 +18,7 @@ namespace dgn
     void Texture::dispose()
     {
         glCall(glDeleteTextures(1, &m_texture));
+        invalidateGLStateInternal();
     }
 
     //////////////////////////////////////////////
@@ -46,6 +48,7 @@ namespace dgn
         }
 
         glCall(glBindTexture(GL_TEXTURE_1D, 0));
+        invalidateGLStateInternal();
 
         return *this;
     }
@@ -53,6 +56,8 @@ namespace dgn
     Texture& Texture::loadAs1D(std::string filepath, TextureWrap wrap, TextureFilter filter,
             TextureStorage internal_storage, float anisotropy)
     {
+        DGN_PROFILE_SCOPE("TextureLoad");
+
         std::vector<unsigned char> pixels;
         unsigned width, height;
 
@@ -96,6 +101,7 @@ namespace dgn
         }
 
         glCall(glBindTexture(GL_TEXTURE_2D, 0));
+        invalidateGLStateInternal();
 
         return *this;
     }
@@ -103,6 +109,8 @@ namespace dgn
     Texture& Texture::loadAs2D(std::string filepath, TextureWrap wrap, TextureFilter filter,
                                    TextureStorage internal_storage, float anisotropy)
     {
+        DGN_PROFILE_SCOPE("TextureLoad");
+
         std::vector<unsigned char> pixels;
         unsigned width, height;
 
@@ -146,6 +154,7 @@ namespace dgn
         }
 
         glCall(glBindTexture(GL_TEXTURE_3D, 0));
+        invalidateGLStateInternal();
 
         return *this;
     }
@@ -153,6 +162,8 @@ namespace dgn
     Texture& Texture::loadAs3D(std::string filepath, unsigned depth, TextureWrap wrap, TextureFilter filter,
             TextureStorage internal_storage, float anisotropy)
     {
+        DGN_PROFILE_SCOPE("TextureLoad");
+
         std::vector<unsigned char> pixels;
         unsigned width, height;
 
@@ -169,6 +180,93 @@ namespace dgn
     }
 
 
+    //////////////////////////////////////////////
+    //               2D Array                   //
+    //////////////////////////////////////////////
+
+    Texture& Texture::createAs2DArray(const void *data, TextureData data_type, unsigned width, unsigned height, unsigned layers,
+            TextureWrap wrap, TextureFilter filter,
+            TextureStorage internal_storage, TextureStorage given_storage, float anisotropy)
+    {
+        m_type = TextureType::Texture2DArray;
+        m_width[0] = width;
+        m_height[0] = height;
+        m_depth = layers;
+
+        glCall(glGenTextures(1, &m_texture));
+        glCall(glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture));
+
+        setWrap(wrap);
+        setFilter(filter);
+
+        glCall(glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, int(internal_storage), width, height, layers, 0, int(given_storage), int(data_type), data));
+
+        if(int(filter) >= int(TextureFilter::Trilinear))
+        {
+            generateMipmaps();
+            setAnisotropy(anisotropy);
+        }
+
+        glCall(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+        invalidateGLStateInternal();
+
+        return *this;
+    }
+
+    Texture& Texture::loadAs2DArray(const std::vector<std::string>& filepaths, TextureWrap wrap, TextureFilter filter,
+            TextureStorage internal_storage, float anisotropy)
+    {
+        DGN_PROFILE_SCOPE("TextureLoad");
+
+        std::vector<unsigned char> pixels;
+        std::vector<unsigned char> layer;
+        unsigned width = 0, height = 0;
+
+        for(const std::string& filepath : filepaths)
+        {
+            unsigned w, h;
+            unsigned error = lodepng::decode(layer, w, h, filepath);
+            if(error)
+            {
+                std::string s = lodepng_error_text(error);
+                s += "\n\tFile" + filepath;
+                logError("PNG LOADING", s.c_str());
+                return *this;
+            }
+
+            if(pixels.empty())
+            {
+                width = w;
+                height = h;
+            }
+            else if(w != width || h != height)
+            {
+                logError("TEXTURE ARRAY LAYER SIZE", filepath.c_str());
+                return *this;
+            }
+
+            pixels.insert(pixels.end(), layer.begin(), layer.end());
+        }
+
+        return createAs2DArray(pixels.data(), TextureData::Ubyte, width, height, filepaths.size(), wrap, filter, internal_storage, TextureStorage::RGBA, anisotropy);
+    }
+
+    Texture& Texture::setLayer(unsigned layer, const void *data, TextureData data_type, TextureStorage given_storage)
+    {
+        if(m_type != TextureType::Texture2DArray || layer >= m_depth)
+        {
+            logError("TEXTURE ARRAY", "layer out of range");
+            return *this;
+        }
+
+        glCall(glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture));
+        glCall(glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, m_width[0], m_height[0], 1, int(given_storage), int(data_type), data));
+        glCall(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+        invalidateGLStateInternal();
+
+        return *this;
+    }
+
     //////////////////////////////////////////////
     //                Cubemap                   //
     //////////////////////////////////////////////
@@ -208,6 +306,7 @@ namespace dgn
         }
 
         glCall(glBindTexture(GL_TEXTURE_CUBE_MAP, 0));
+        invalidateGLStateInternal();
 
         return *this;
     }
@@ -231,6 +330,8 @@ namespace dgn
     Texture& Texture::loadAsCube(std::string filepath[6], TextureWrap wrap, TextureFilter filter,
             TextureStorage internal_storage, float anisotropy)
     {
+        DGN_PROFILE_SCOPE("TextureLoad");
+
         std::vector<unsigned char> pixels[6];
         unsigned width[6], height[6];
         const void *data[6];
@@ -289,6 +390,14 @@ namespace dgn
         return m_height[(unsigned)face];
     }
 
+    Texture& Texture::setDepthCompare(bool enabled)
+    {
+        glCall(glTexParameteri((int)m_type, GL_TEXTURE_COMPARE_MODE, enabled ? GL_COMPARE_REF_TO_TEXTURE : GL_NONE));
+        glCall(glTexParameteri((int)m_type, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL));
+
+        return *this;
+    }
+
     Texture& Texture::setBorderColor(float r, float g, float b, float a)
     {
         float color[] = {r, g, b, a};
@@ -0,0 +1,211 @@
+#include "DragonEngine/UniformBuffer.h"
+#include "d_internal.h"
+
+#include <glad/glad.h>
+
+#include <m3d/vec2.h>
+#include <m3d/vec3.h>
+#include <m3d/vec4.h>
+#include <m3d/mat3x3.h>
+#include <m3d/mat4x4.h>
+
+#include <algorithm>
+#include <string.h>
+
+namespace dgn
+{
+    ////////////////////////////////////////
+    //              LAYOUT                //
+    ////////////////////////////////////////
+
+    UniformLayout::UniformLayout() : m_size(0) {}
+
+    unsigned UniformLayout::addInternal(unsigned alignment, unsigned size)
+    {
+        unsigned offset = (m_size + alignment - 1) / alignment * alignment;
+        m_size = offset + size;
+
+        return offset;
+    }
+
+    unsigned UniformLayout::addFloat() { return addInternal(4, 4); }
+    unsigned UniformLayout::addInt()   { return addInternal(4, 4); }
+    unsigned UniformLayout::addVec2()  { return addInternal(8, 8); }
+    unsigned UniformLayout::addVec3()  { return addInternal(16, 12); }
+    unsigned UniformLayout::addVec4()  { return addInternal(16, 16); }
+    unsigned UniformLayout::addMat3()  { return addInternal(16, 48); }
+    unsigned UniformLayout::addMat4()  { return addInternal(16, 64); }
+
+    UniformArray UniformLayout::addArrayInternal(unsigned stride, unsigned count)
+    {
+        UniformArray array;
+        array.offset = addInternal(16, count * stride);
+        array.stride = stride;
+        array.count = count;
+
+        return array;
+    }
+
+    UniformArray UniformLayout::addFloatArray(unsigned count) { return addArrayInternal(16, count); }
+    UniformArray UniformLayout::addIntArray(unsigned count)   { return addArrayInternal(16, count); }
+    UniformArray UniformLayout::addVec4Array(unsigned count)  { return addArrayInternal(16, count); }
+    UniformArray UniformLayout::addMat4Array(unsigned count)  { return addArrayInternal(64, count); }
+
+    unsigned UniformArray::element(unsigned index) const
+    {
+        if(index >= count)
+        {
+            logError("UNIFORM LAYOUT", "array index out of range");
+            if(count == 0) return offset;
+            index = count - 1;
+        }
+
+        return offset + index * stride;
+    }
+
+    unsigned UniformLayout::getSize() const
+    {
+        return (m_size + 15) / 16 * 16;
+    }
+
+    ////////////////////////////////////////
+    //              BUFFER                //
+    ////////////////////////////////////////
+
+    UniformBuffer::UniformBuffer() : m_buffer(0), m_dirty_begin(0), m_dirty_end(0) {}
+
+    void UniformBuffer::dispose()
+    {
+        if(m_buffer)
+        {
+            glCall(glDeleteBuffers(1, &m_buffer));
+            invalidateGLStateInternal();
+        }
+
+        m_buffer = 0;
+        m_data.clear();
+        m_dirty_begin = m_dirty_end = 0;
+    }
+
+    UniformBuffer& UniformBuffer::create(unsigned size)
+    {
+        m_data.assign(size, 0);
+        m_dirty_begin = m_dirty_end = 0;
+
+        glCall(glGenBuffers(1, &m_buffer));
+        glCall(glBindBuffer(GL_UNIFORM_BUFFER, m_buffer));
+        glCall(glBufferData(GL_UNIFORM_BUFFER, size, m_data.data(), GL_DYNAMIC_DRAW));
+        glCall(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+
+        invalidateGLStateInternal();
+
+        return *this;
+    }
+
+    UniformBuffer& UniformBuffer::create(const UniformLayout& layout)
+    {
+        return create(layout.getSize());
+    }
+
+    void UniformBuffer::writeInternal(unsigned offset, const void* data, unsigned size)
+    {
+        if(offset + size > m_data.size())
+        {
+            logError("UNIFORM BUFFER", "write past the end of the buffer");
+            return;
+        }
+
+        memcpy(&m_data[offset], data, size);
+
+        if(m_dirty_begin == m_dirty_end)
+        {
+            m_dirty_begin = offset;
+            m_dirty_end = offset + size;
+        }
+        else
+        {
+            m_dirty_begin = std::min(m_dirty_begin, offset);
+            m_dirty_end = std::max(m_dirty_end, offset + size);
+        }
+    }
+
+    UniformBuffer& UniformBuffer::set(unsigned offset, float value)
+    {
+        writeInternal(offset, &value, sizeof(value));
+        return *this;
+    }
+
+    UniformBuffer& UniformBuffer::set(unsigned offset, int value)
+    {
+        writeInternal(offset, &value, sizeof(value));
+        return *this;
+    }
+
+    UniformBuffer& UniformBuffer::set(unsigned offset, const m3d::vec2& value)
+    {
+        float v[2] = {value.x, value.y};
+        writeInternal(offset, v, sizeof(v));
+        return *this;
+    }
+
+    UniformBuffer& UniformBuffer::set(unsigned offset, const m3d::vec3& value)
+    {
+        float v[3] = {value.x, value.y, value.z};
+        writeInternal(offset, v, sizeof(v));
+        return *this;
+    }
+
+    UniformBuffer& UniformBuffer::set(unsigned offset, const m3d::vec4& value)
+    {
+        float v[4] = {value.x, value.y, value.z, value.w};
+        writeInternal(offset, v, sizeof(v));
+        return *this;
+    }
+
+    // m3d matrices are row major and std140 stores columns, so rows become the padded columns
+    UniformBuffer& UniformBuffer::set(unsigned offset, const m3d::mat3x3& value)
+    {
+        float v[3][4] = {};
+        for(int c = 0; c < 3; c++)
+        {
+            for(int r = 0; r < 3; r++)
+            {
+                v[c][r] = value.m[r][c];
+            }
+        }
+
+        writeInternal(offset, v, sizeof(v));
+        return *this;
+    }
+
+    UniformBuffer& UniformBuffer::set(unsigned offset, const m3d::mat4x4& value)
+    {
+        float v[4][4];
+        for(int c = 0; c < 4; c++)
+        {
+            for(int r = 0; r < 4; r++)
+            {
+                v[c][r] = value.m[r][c];
+            }
+        }
+
+        writeInternal(offset, v, sizeof(v));
+        return *this;
+    }
+
+    void UniformBuffer::upload()
+    {
+        if(m_dirty_begin == m_dirty_end) return;
+
+        glCall(glBindBuffer(GL_UNIFORM_BUFFER, m_buffer));
+        glCall(glBufferSubData(GL_UNIFORM_BUFFER, m_dirty_begin, m_dirty_end - m_dirty_begin, &m_data[m_dirty_begin]));
+        glCall(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+
+        m_dirty_begin = m_dirty_end = 0;
+    }
+
+    unsigned UniformBuffer::getSize() const
+    {
+        return m_data.size();
+    }
+}
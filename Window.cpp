@@ -1,4 +1,5 @@
 #include "DragonEngine/Window.h"
+#include "DragonEngine/Profiler.h"
 
 #include "d_internal.h"
 
@@ -21,9 +22,13 @@ namespace dgn
             return false;
         }
 
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
         glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __DEBUG__
+        // debug contexts report far more through KHR_debug
+        glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+#endif
 
         native_window = glfwCreateWindow(width, height, title.c_str(), NULL, NULL);
         if(native_window == nullptr)
@@ -74,6 +79,8 @@ namespace dgn
 
     void Window::swapBuffers()
     {
+        DGN_PROFILE_SCOPE("SwapBuffers");
+
         glfwSwapBuffers(native_window);
 
         frame_count++;
@@ -1,10 +1,29 @@
+#include "DragonEngine/ErrorString.h"
+
 #include <glad/glad.h>
 
 #include <stdio.h>
 #include <queue>
+#include <atomic>
 #include <string>
+#include <mutex>
 
+// filled from worker threads and, with asynchronous debug output, from driver threads
 static std::queue<std::string> s_errors;
+static std::mutex s_errors_mutex;
+
+// set on the context thread, read by the debug callback on driver threads
+#ifdef __DEBUG__
+static std::atomic<dgn::DebugMode> s_debug_mode{dgn::DebugMode::GetError};
+#else
+static std::atomic<dgn::DebugMode> s_debug_mode{dgn::DebugMode::None};
+#endif // __DEBUG__
+
+static void pushErrorInternal(const std::string& error)
+{
+    std::lock_guard<std::mutex> lock(s_errors_mutex);
+    s_errors.push(error);
+}
 
 void clearGLErrorsInternal()
 {
@@ -16,28 +35,28 @@ static void printErrorInternal(unsigned error)
     switch(error)
     {
     case GL_INVALID_ENUM:
-        s_errors.push("GLERROR::INVALID ENUM\n");
+        pushErrorInternal("GLERROR::INVALID ENUM\n");
         break;
     case GL_INVALID_VALUE:
-        s_errors.push("GLERROR::INVALID VALUE\n");
+        pushErrorInternal("GLERROR::INVALID VALUE\n");
         break;
     case GL_INVALID_OPERATION:
-        s_errors.push("GLERROR::INVALID OPERATION\n");
+        pushErrorInternal("GLERROR::INVALID OPERATION\n");
         break;
     case GL_STACK_OVERFLOW:
-        s_errors.push("GLERROR::STACK OVERFLOW\n");
+        pushErrorInternal("GLERROR::STACK OVERFLOW\n");
         break;
     case GL_STACK_UNDERFLOW:
-        s_errors.push("GLERROR::STACK UNDERFLOW\n");
+        pushErrorInternal("GLERROR::STACK UNDERFLOW\n");
         break;
     case GL_OUT_OF_MEMORY:
         printf("GLERROR::OUT OF MEMORY\n");
         break;
     case GL_INVALID_FRAMEBUFFER_OPERATION:
-        s_errors.push("GLERROR::INVALID FRAMEBUFFER OPERATION\n");
+        pushErrorInternal("GLERROR::INVALID FRAMEBUFFER OPERATION\n");
         break;
     default:
-        s_errors.push("GLERROR::UNKNOWN ERROR\n");
+        pushErrorInternal("GLERROR::UNKNOWN ERROR\n");
     }
 }
 
@@ -57,18 +76,173 @@ bool checkGLErrorsInternal()
 
 void logError(const char* error, const char* message)
 {
-    s_errors.push("ERROR::" + std::string(error) + " " + std::string(message) + "\n");
+    pushErrorInternal("ERROR::" + std::string(error) + " " + std::string(message) + "\n");
+}
+
+#ifdef __DEBUG__
+struct CallSiteInternal
+{
+    const char *file = "";
+    int line = 0;
+    const char *call = "";
+};
+
+static CallSiteInternal s_call_site;
+
+void glCallBeginInternal(const char* file, int line, const char* call)
+{
+    s_call_site.file = file;
+    s_call_site.line = line;
+    s_call_site.call = call;
+
+    if(s_debug_mode == dgn::DebugMode::GetError) clearGLErrorsInternal();
+}
+
+void glCallEndInternal()
+{
+    if(s_debug_mode != dgn::DebugMode::GetError) return;
+
+    if(!checkGLErrorsInternal())
+    {
+        pushErrorInternal("    at " + std::string(s_call_site.file) + ":" + std::to_string(s_call_site.line) + " " + s_call_site.call + "\n");
+    }
+}
+#endif // __DEBUG__
+
+static const char *debugSourceInternal(GLenum source)
+{
+    switch(source)
+    {
+    case GL_DEBUG_SOURCE_API:             return "API";
+    case GL_DEBUG_SOURCE_WINDOW_SYSTEM:   return "WINDOW SYSTEM";
+    case GL_DEBUG_SOURCE_SHADER_COMPILER: return "SHADER COMPILER";
+    case GL_DEBUG_SOURCE_THIRD_PARTY:     return "THIRD PARTY";
+    case GL_DEBUG_SOURCE_APPLICATION:     return "APPLICATION";
+    default:                              return "OTHER";
+    }
+}
+
+static const char *debugTypeInternal(GLenum type)
+{
+    switch(type)
+    {
+    case GL_DEBUG_TYPE_ERROR:               return "ERROR";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "DEPRECATED BEHAVIOR";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  return "UNDEFINED BEHAVIOR";
+    case GL_DEBUG_TYPE_PORTABILITY:         return "PORTABILITY";
+    case GL_DEBUG_TYPE_PERFORMANCE:         return "PERFORMANCE";
+    default:                                return "OTHER";
+    }
+}
+
+static void APIENTRY debugCallbackInternal(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                           GLsizei length, const GLchar* message, const void* user_param)
+{
+    std::string error = "GLDEBUG::" + std::string(debugSourceInternal(source)) + " " + debugTypeInternal(type) +
+                        " " + std::to_string(id) + " " + std::string(message, length) + "\n";
+
+#ifdef __DEBUG__
+    // only meaningful when the callback runs inside the call that caused it
+    if(s_debug_mode == dgn::DebugMode::Synchronous)
+    {
+        error += "    at " + std::string(s_call_site.file) + ":" + std::to_string(s_call_site.line) + " " + s_call_site.call + "\n";
+    }
+#endif // __DEBUG__
+
+    pushErrorInternal(error);
+}
+
+static unsigned s_gl_state_generation = 0;
+
+void invalidateGLStateInternal()
+{
+    // wrapping around is fine, it only has to differ from what a Renderer last saw
+    s_gl_state_generation++;
+}
+
+unsigned glStateGenerationInternal()
+{
+    return s_gl_state_generation;
 }
 
 namespace dgn
 {
     const char *getErrorString()
     {
+        // the popped string has to outlive the returned pointer until the next call
+        static std::string current;
+
+        std::lock_guard<std::mutex> lock(s_errors_mutex);
         if(s_errors.size() < 1) return nullptr;
 
-        const char *res = s_errors.front().c_str();
+        current = s_errors.front();
         s_errors.pop();
+        return current.c_str();
+    }
+
+    bool setDebugMode(DebugMode mode)
+    {
+        bool callback = mode == DebugMode::Async || mode == DebugMode::Synchronous;
+        bool res = true;
+
+        if(callback && !GLAD_GL_KHR_debug)
+        {
+#ifdef __DEBUG__
+            logError("DEBUG MODE", "KHR_debug not supported, falling back to glGetError");
+            mode = DebugMode::GetError;
+#else
+            logError("DEBUG MODE", "KHR_debug not supported, gl errors are not reported");
+            mode = DebugMode::None;
+#endif // __DEBUG__
+            callback = false;
+            res = false;
+        }
+
+#ifndef __DEBUG__
+        // glGetError is only checked around the glCall wrappers, which release builds compile away
+        if(mode == DebugMode::GetError)
+        {
+            logError("DEBUG MODE", "glGetError checks need a debug build");
+            mode = DebugMode::None;
+            res = false;
+        }
+#endif // __DEBUG__
+
+        if(GLAD_GL_KHR_debug)
+        {
+            if(callback)
+            {
+                glEnable(GL_DEBUG_OUTPUT);
+                glDebugMessageCallback(debugCallbackInternal, nullptr);
+                glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+                // buffer placement and similar driver chatter
+                glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+            }
+            else
+            {
+                glDisable(GL_DEBUG_OUTPUT);
+                glDebugMessageCallback(nullptr, nullptr);
+            }
+
+            if(mode == DebugMode::Synchronous)
+            {
+                glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+            }
+            else
+            {
+                glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+            }
+        }
+
+        // errors raised before the switch belong to no call site
+        clearGLErrorsInternal();
+        s_debug_mode = mode;
+
         return res;
     }
-}
 
+    DebugMode getDebugMode()
+    {
+        return s_debug_mode;
+    }
+}
@@ -0,0 +1,112 @@
+#include "d_internal.h"
+
+#include <sys/stat.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+bool mapFileInternal(const char* filepath, MappedFileInternal& file)
+{
+    file = MappedFileInternal();
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(handle == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(handle, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(mapping == NULL)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(data == NULL)
+    {
+        CloseHandle(mapping);
+        CloseHandle(handle);
+        return false;
+    }
+
+    file.data = (const unsigned char*)data;
+    file.size = size_t(size.QuadPart);
+    file.handle = handle;
+    file.mapping = mapping;
+#else
+    int fd = open(filepath, O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(data == MAP_FAILED) return false;
+
+    file.data = (const unsigned char*)data;
+    file.size = size_t(st.st_size);
+#endif
+
+    return true;
+}
+
+void unmapFileInternal(MappedFileInternal& file)
+{
+    if(file.data == nullptr) return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(file.data);
+    CloseHandle((HANDLE)file.mapping);
+    CloseHandle((HANDLE)file.handle);
+#else
+    munmap((void*)file.data, file.size);
+#endif
+
+    file = MappedFileInternal();
+}
+
+bool fileStatInternal(const char* filepath, int64_t& time, uint64_t& size)
+{
+    struct stat st;
+    if(stat(filepath, &st) != 0) return false;
+
+    time = int64_t(st.st_mtime);
+    size = uint64_t(st.st_size);
+    return true;
+}
+
+bool makeDirectoryInternal(const char* path)
+{
+#ifdef _WIN32
+    return CreateDirectoryA(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+void writeEscapedInternal(FILE* file, const char* str)
+{
+    for(; *str; str++)
+    {
+        if(*str == '"' || *str == '\\') fputc('\\', file);
+        fputc(*str, file);
+    }
+}
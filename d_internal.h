@@ -1,11 +1,53 @@
 #pragma once
 
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 
 void clearGLErrorsInternal();
 bool checkGLErrorsInternal();
 
 void logError(const char* error, const char* message);
 
-#define glCall(func) clearGLErrorsInternal(); func; checkGLErrorsInternal()
+// Debug builds record the call site of every gl call, so synchronous debug output can report where a message
+// came from, and run glGetError around it when the debug mode asks for it. Release builds issue the bare call
+// and rely on the asynchronous debug callback.
+#ifdef __DEBUG__
+void glCallBeginInternal(const char* file, int line, const char* call);
+void glCallEndInternal();
 
+#define glCall(func) glCallBeginInternal(__FILE__, __LINE__, #func); func; glCallEndInternal()
+#else
+#define glCall(func) func
+#endif
+
+// Called by engine code that changes gl bindings outside of the Renderer, or creates or deletes gl objects
+// whose names could be reused, so every Renderer drops its cached state
+void invalidateGLStateInternal();
+unsigned glStateGenerationInternal();
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define DGN_SSE
+#include <xmmintrin.h>
+#endif
+
+// Read only view of a whole file mapped into memory
+struct MappedFileInternal
+{
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+    void *handle = nullptr;
+    void *mapping = nullptr;
+};
+
+bool mapFileInternal(const char* filepath, MappedFileInternal& file);
+void unmapFileInternal(MappedFileInternal& file);
+
+// Modification time and size of a file, returns false if the file does not exist
+bool fileStatInternal(const char* filepath, int64_t& time, uint64_t& size);
+
+// Creates one directory level, returns true if it exists afterwards
+bool makeDirectoryInternal(const char* path);
+
+// Writes str with quotes and backslashes escaped, for names inside json strings
+void writeEscapedInternal(FILE* file, const char* str);
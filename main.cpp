@@ -1,10 +1,27 @@
 #include "Window.h"
 #include "Camera.h"
 #include "ShadowMap.h"
+#include "DrawIndirectBuffer.h"
+#include "Frustum.h"
+#include "MeshArena.h"
+#include "MeshOptimizer.h"
+#include "RenderQueue.h"
+#include "CommandList.h"
+#include "ErrorString.h"
+#include "GpuProfiler.h"
+#include "Profiler.h"
+#include "UniformBuffer.h"
+#include "MaterialArray.h"
 
 #include <stdio.h>
 #include <algorithm>
 #include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
 
 #include <m3d/math1D.h>
 #include <m3d/vec3.h>
@@ -28,7 +45,22 @@
 #define SHADOW_FAR 35
 #define CASCADE_SPLIT_BLEND 0.4
 
+#define CAMERA_BLOCK_BINDING 0
+#define CASCADE_BLOCK_BINDING 1
+
+// every material map is authored at this size, so all of them fit one array layer
+#define MATERIAL_SIZE 1024
+// one layer per material the demo adds, each layer costs 4 MB in each of the five maps plus mips
+#define MAX_MATERIALS 8
+
+#define SCENE_ARENA_VERTICES (512 * 1024)
+#define SCENE_ARENA_INDICES (2 * 1024 * 1024)
+
 void updateCamera(dgn::Camera *camera, dgn::Window *window, float delta, bool controller);
+void benchmarkMeshCache(dgn::Window *window, const char *filepath);
+void printMeshOptimizeStats(const char *filepath);
+void benchmarkDebugModes(dgn::Window *window, const dgn::Mesh& mesh, const dgn::Shader& shader);
+void benchmarkShadowFit(dgn::Window *window, const float *distances);
 
 void drawLineBox(const tgr::AABB& box, int uniforms[], const dgn::Renderer& renderer);
 void drawLineSphere(const tgr::Sphere& sphere, int uniforms[], const dgn::Renderer& renderer);
@@ -36,10 +68,38 @@ void drawPlane(const tgr::Plane& plane, int uniforms[], const dgn::Renderer& ren
 void drawPoint(const m3d::vec3& point, int uniforms[], const dgn::Renderer& renderer);
 //void drawTriangle(const dgn::Triangle& tri, int uniforms[], const dgn::Renderer& renderer);
 
+// Runs its job once per kick on a thread kept for the whole run, so recording a pass every frame
+// costs a wake up instead of a thread creation
+class FrameWorker
+{
+private:
+    std::function<void()> m_job;
+    std::mutex m_mutex;
+    std::condition_variable m_signal;
+    bool m_pending;
+    bool m_quit;
+    std::thread m_thread;
+
+    void runInternal();
+
+public:
+    explicit FrameWorker(std::function<void()> job);
+    ~FrameWorker();
+
+    void kick();
+    void wait();
+};
+
 int main(int argc, const char* argv[])
 {
     dgn::Window main_window;
 
+    // started before the window so loading hitches are recorded too, T writes the trace
+    if(argc > 1 && std::string(argv[1]) == "--trace")
+    {
+        dgn::setCpuProfiling(true);
+    }
+
     main_window.initialize(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE);
 
     main_window.setVsync(dgn::VsyncMode::Single);
@@ -53,6 +113,88 @@ int main(int argc, const char* argv[])
     main_window.getRenderer().enableFlag(dgn::RenderFlag::SeamlessCubemaps);
     main_window.getRenderer().enableFlag(dgn::RenderFlag::CullFace);
 
+    // linked programs are kept here between runs, so only edited shaders compile at startup
+    dgn::Shader::setProgramCacheDir("src/res/shaders/cache");
+
+    // Every program is handed to the driver here and finished where it is first used, so with
+    // KHR_parallel_shader_compile the compiles run on driver threads while meshes and textures load
+    dgn::Shader::setEconst("CASCADES", SHADOW_CASCADES);
+
+    dgn::Shader screen_shader;
+    dgn::Shader shadow_shader;
+    dgn::Shader skybox_shader;
+    dgn::Shader shader;
+    dgn::Shader skin_shader;
+    dgn::Shader reflection_probe_shader;
+    dgn::Shader line_shader;
+    dgn::Shader color_lut_shader;
+
+    // Flat shaded stand in for the pbr shader, drawn in the main loop if pbr_lite fails to build.
+    // It reads the same Camera block, draw data and uModelMat and uMaterial handles.
+    const char *fallback_vert = R"(
+        #version 450 core
+        #extension GL_ARB_shader_draw_parameters : require
+
+        layout(location = 0) in vec3 aPos;
+        layout(location = 2) in vec3 aNormal;
+
+        layout(std140) uniform Camera { mat4 uViewProj; mat4 uSkyViewProj; vec3 uCamPos; vec3 uSunDir; };
+
+        // the draw data holds row major m3d matrices
+        struct Draw { mat4 model; uint material; uint cascade_mask; uint padding[2]; };
+        layout(std430, binding = 0) readonly buffer DrawData { Draw draws[]; };
+
+        uniform mat4 uModelMat;
+        uniform int uMaterial;
+
+        out vec3 vNormal;
+
+        void main()
+        {
+            mat4 model = uMaterial < 0 ? transpose(draws[gl_DrawIDARB].model) : uModelMat;
+            vNormal = mat3(model) * aNormal;
+            gl_Position = uViewProj * model * vec4(aPos, 1.0);
+        }
+    )";
+
+    const char *fallback_frag = R"(
+        #version 450 core
+
+        layout(std140) uniform Camera { mat4 uViewProj; mat4 uSkyViewProj; vec3 uCamPos; vec3 uSunDir; };
+
+        in vec3 vNormal;
+        out vec4 fColor;
+
+        void main()
+        {
+            float light = max(dot(normalize(vNormal), -uSunDir), 0.0) * 0.8 + 0.2;
+            fColor = vec4(vec3(0.5 * light), 1.0);
+        }
+    )";
+
+    dgn::Shader fallback_shader;
+    fallback_shader.createFromData(fallback_vert, "", fallback_frag);
+    shader.setFallback(&fallback_shader);
+
+    screen_shader.loadFromFilesAsync("src/res/shaders/screen.vert", "", "src/res/shaders/screen.frag");
+    shadow_shader.loadFromFilesAsync("src/res/shaders/shadow.vert", "src/res/shaders/shadow.geom", "");
+    skybox_shader.loadFromFilesAsync("src/res/shaders/skybox.vert", "", "src/res/shaders/skybox.frag");
+    shader.loadFromFilesAsync("src/res/shaders/pbr_lite.vert", "", "src/res/shaders/pbr_lite.frag");
+    skin_shader.loadFromFilesAsync("src/res/shaders/skin.vert", "", "src/res/shaders/skin.frag");
+    reflection_probe_shader.loadFromFilesAsync("src/res/shaders/skybox.vert", "", "src/res/shaders/reflectionProbe.frag");
+    line_shader.loadFromFilesAsync("src/res/shaders/line.vert", "", "src/res/shaders/line.frag");
+    color_lut_shader.loadFromFilesAsync("src/res/shaders/3d_texture.vert", "", "src/res/shaders/3d_texture.frag");
+
+    if(argc > 1 && std::string(argv[1]) == "--bench-mesh-cache")
+    {
+        benchmarkMeshCache(&main_window, "src/res/models/forest_level.obj");
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "--mesh-stats")
+    {
+        printMeshOptimizeStats("src/res/models/forest_level.obj");
+    }
+
     std::vector<float> screen_vertices =
     {
         -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
@@ -61,7 +203,7 @@ int main(int argc, const char* argv[])
          1.0f, -1.0f, 0.0f, 1.0f, 0.0f
     };
 
-    std::vector<unsigned> screen_indices =
+    std::vector<uint16_t> screen_indices =
     {
         0, 2, 1,
         0, 3, 2
@@ -78,8 +220,7 @@ int main(int argc, const char* argv[])
                                   dgn::TextureWrap::ClampToEdge, dgn::TextureFilter::Nearest,
                                   dgn::TextureStorage::RGBA16F, dgn::TextureStorage::RGB);
 
-    dgn::Shader screen_shader;
-    screen_shader.loadFromFiles("src/res/shaders/screen.vert", "", "src/res/shaders/screen.frag");
+    screen_shader.finish();
 
     unsigned screen_u_texture = screen_shader.getUniformLocation("uScreen");
     unsigned screen_u_color_lut = screen_shader.getUniformLocation("uColorLut");
@@ -92,11 +233,14 @@ int main(int argc, const char* argv[])
 
     /////////////////////////////////////////////////////
 
-    dgn::ShadowMap shadowmap[SHADOW_CASCADES];
+    // near cascades follow the camera every frame, far ones move less on screen and can lag behind.
+    // The casters are static, so with a still sun and camera nothing is re-rendered at all.
+    dgn::CascadedShadowMap shadowmap;
+    shadowmap.initialize(SHADOW_SIZE, SHADOW_SIZE, SHADOW_CASCADES);
 
     for(int i = 0; i < SHADOW_CASCADES; i++)
     {
-        shadowmap[i].initialize(SHADOW_SIZE, SHADOW_SIZE);
+        shadowmap.setUpdateInterval(i, 1 << i);
     }
 
     int cascade_depths_count = SHADOW_CASCADES + 1;
@@ -111,145 +255,187 @@ int main(int argc, const char* argv[])
         cascade_distances[i] = m3d::lerp(dist_log, dist_uni, CASCADE_SPLIT_BLEND);
     }
 
-    dgn::Shader shadow_shader;
-    shadow_shader.loadFromFiles("src/res/shaders/shadow.vert", "", "");
+    if(argc > 1 && std::string(argv[1]) == "--bench-shadow-fit")
+    {
+        benchmarkShadowFit(&main_window, cascade_distances);
+    }
 
-    int shadow_u_light = shadow_shader.getUniformLocation("uLight");
-    int shadow_u_model = shadow_shader.getUniformLocation("uModel");
+    // the geometry shader runs CASCADES invocations per triangle, each writing gl_Layer, and skips the
+    // cascades missing from uCascadeMask, or from the draw data's cascade_mask when uCascadeMask is 0
+    shadow_shader.finish();
 
-    dgn::Shader::setEconst("CASCADES", SHADOW_CASCADES);
+    int shadow_u_cascade_mask = shadow_shader.getUniformLocation("uCascadeMask");
+    int shadow_u_model = shadow_shader.getUniformLocation("uModel");
 
     /////////////////////////////////////////////////////
 
     dgn::Mesh skybox_mesh;
     skybox_mesh = dgn::Mesh::loadFromFile("src/res/models/skybox.obj")[0];
 
-    dgn::Shader skybox_shader;
-    skybox_shader.loadFromFiles("src/res/shaders/skybox.vert", "", "src/res/shaders/skybox.frag");
+    skybox_shader.finish();
 
-    int skybox_u_vp        = skybox_shader.getUniformLocation("uVP");
     int skybox_u_texture   = skybox_shader.getUniformLocation("uTexture");
-    int skybox_u_sun_dir   = skybox_shader.getUniformLocation("uSunDir");
 
     /////////////////////////////////////////////////////
 
     std::vector<dgn::Mesh> scene;
     dgn::Mesh ball;
 
-    dgn::Texture bricks_texture[5];
-    dgn::Texture concrete_texture[5];
-    dgn::Texture grass_texture[5];
-    dgn::Texture plaster_texture[5];
-    dgn::Texture paint_wood_texture[5];
-    dgn::Texture planks_texture[5];
-    dgn::Texture wood_texture[5];
-    dgn::Texture metal_plates_texture[5];
+    dgn::MaterialArray materials;
 
     dgn::Texture skybox;
-    dgn::Shader shader;
-    dgn::Shader skin_shader;
 
-    scene = dgn::Mesh::loadFromFile("src/res/models/forest_level.obj");
-    ball = dgn::Mesh::loadFromFile("src/res/models/ball.obj")[0];
+    // position, uv, normal, tangent
+    dgn::MeshArena scene_arena;
+    scene_arena.create(11 * sizeof(float), SCENE_ARENA_VERTICES, SCENE_ARENA_INDICES);
+    scene_arena.addVertexAttrib(0, 3).addVertexAttrib(1, 2).addVertexAttrib(2, 3).addVertexAttrib(3, 3);
+    scene_arena.addPositionStream().complete();
 
-    dgn::Texture white_texture;
-    white_texture.loadAs2D("src/res/textures/white.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    dgn::Texture black_texture;
-    black_texture.loadAs2D("src/res/textures/black.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
+    dgn::MeshImportSettings scene_import;
+    scene_import.arena = &scene_arena;
+
+    scene = dgn::Mesh::loadFromFile("src/res/models/forest_level.obj", scene_import);
+    ball = dgn::Mesh::loadFromFile("src/res/models/ball.obj", scene_import)[0];
+
+    if(argc > 1 && std::string(argv[1]) == "--bench-debug-modes")
+    {
+        benchmarkDebugModes(&main_window, ball, shadow_shader);
+    }
 
     dgn::Texture irrad_texture[2];
     irrad_texture[0].loadAs2D("src/res/textures/irrad_1.png", dgn::TextureWrap::ClampToEdge, dgn::TextureFilter::Bilinear, dgn::TextureStorage::SRGB);
     irrad_texture[1].loadAs2D("src/res/textures/irrad_2.png", dgn::TextureWrap::ClampToEdge, dgn::TextureFilter::Bilinear, dgn::TextureStorage::SRGB);
 
-    bricks_texture[0].loadAs2D("src/res/textures/bricks_1/color.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::SRGB);
-    concrete_texture[0].loadAs2D("src/res/textures/concrete_1/color.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::SRGB);
-    grass_texture[0].loadAs2D("src/res/textures/ground_1/color.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::SRGB);
-    plaster_texture[0].loadAs2D("src/res/textures/paint_plaster_1/color.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::SRGB);
-    paint_wood_texture[0].loadAs2D("src/res/textures/paint_wood_1/color.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::SRGB);
-    planks_texture[0].loadAs2D("src/res/textures/planks_1/color.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::SRGB);
-    wood_texture[0].loadAs2D("src/res/textures/wood_1/color.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::SRGB);
-    metal_plates_texture[0].loadAs2D("src/res/textures/metal_plates_1/color.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::SRGB);
-
-    bricks_texture[1].loadAs2D("src/res/textures/bricks_1/rough.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    concrete_texture[1].loadAs2D("src/res/textures/concrete_1/rough.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    grass_texture[1].loadAs2D("src/res/textures/ground_1/rough.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    plaster_texture[1].loadAs2D("src/res/textures/paint_plaster_1/rough.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    paint_wood_texture[1].loadAs2D("src/res/textures/paint_wood_1/rough.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    planks_texture[1].loadAs2D("src/res/textures/planks_1/rough.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    wood_texture[1].loadAs2D("src/res/textures/wood_1/rough.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    metal_plates_texture[1].loadAs2D("src/res/textures/metal_plates_1/rough.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-
-    bricks_texture[2]       = black_texture;
-    concrete_texture[2]     = black_texture;
-    grass_texture[2]        = black_texture;
-    plaster_texture[2]      = black_texture;
-    paint_wood_texture[2]   = black_texture;
-    planks_texture[2].loadAs2D("src/res/textures/planks_1/metal.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    wood_texture[2]         = black_texture;
-    metal_plates_texture[2] = white_texture;
-
-    bricks_texture[3].loadAs2D("src/res/textures/bricks_1/normal.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    concrete_texture[3].loadAs2D("src/res/textures/concrete_1/normal.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    grass_texture[3].loadAs2D("src/res/textures/ground_1/normal.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    plaster_texture[3].loadAs2D("src/res/textures/paint_plaster_1/normal.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    paint_wood_texture[3].loadAs2D("src/res/textures/paint_wood_1/normal.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    planks_texture[3].loadAs2D("src/res/textures/planks_1/normal.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    wood_texture[3].loadAs2D("src/res/textures/wood_1/normal.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    metal_plates_texture[3].loadAs2D("src/res/textures/metal_plates_1/normal.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-
-    bricks_texture[4].loadAs2D("src/res/textures/bricks_1/ao.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    concrete_texture[4] = white_texture;
-    grass_texture[4].loadAs2D("src/res/textures/ground_1/ao.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    plaster_texture[4].loadAs2D("src/res/textures/paint_plaster_1/ao.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    paint_wood_texture[4] = white_texture;
-    planks_texture[4].loadAs2D("src/res/textures/planks_1/ao.png", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::RGB);
-    wood_texture[4] = white_texture;
-    metal_plates_texture[4] = white_texture;
+    // color, roughness, metalness, normal, ao. Missing maps get the neutral value, which matches the
+    // white and black placeholder textures the materials used before.
+    std::string bricks_maps[]       = {"src/res/textures/bricks_1/color.png", "src/res/textures/bricks_1/rough.png", "", "src/res/textures/bricks_1/normal.png", "src/res/textures/bricks_1/ao.png"};
+    std::string concrete_maps[]     = {"src/res/textures/concrete_1/color.png", "src/res/textures/concrete_1/rough.png", "", "src/res/textures/concrete_1/normal.png", ""};
+    std::string grass_maps[]        = {"src/res/textures/ground_1/color.png", "src/res/textures/ground_1/rough.png", "", "src/res/textures/ground_1/normal.png", "src/res/textures/ground_1/ao.png"};
+    std::string plaster_maps[]      = {"src/res/textures/paint_plaster_1/color.png", "src/res/textures/paint_plaster_1/rough.png", "", "src/res/textures/paint_plaster_1/normal.png", "src/res/textures/paint_plaster_1/ao.png"};
+    std::string paint_wood_maps[]   = {"src/res/textures/paint_wood_1/color.png", "src/res/textures/paint_wood_1/rough.png", "", "src/res/textures/paint_wood_1/normal.png", ""};
+    std::string planks_maps[]       = {"src/res/textures/planks_1/color.png", "src/res/textures/planks_1/rough.png", "src/res/textures/planks_1/metal.png", "src/res/textures/planks_1/normal.png", "src/res/textures/planks_1/ao.png"};
+    std::string wood_maps[]         = {"src/res/textures/wood_1/color.png", "src/res/textures/wood_1/rough.png", "", "src/res/textures/wood_1/normal.png", ""};
+    std::string metal_plates_maps[] = {"src/res/textures/metal_plates_1/color.png", "src/res/textures/metal_plates_1/rough.png", "src/res/textures/white.png", "src/res/textures/metal_plates_1/normal.png", ""};
+
+    materials.create(MATERIAL_SIZE, MATERIAL_SIZE, MAX_MATERIALS);
+
+    unsigned bricks_material       = materials.addMaterial(bricks_maps);
+    unsigned concrete_material     = materials.addMaterial(concrete_maps);
+    unsigned grass_material        = materials.addMaterial(grass_maps);
+    unsigned plaster_material      = materials.addMaterial(plaster_maps);
+    unsigned paint_wood_material   = materials.addMaterial(paint_wood_maps);
+    unsigned planks_material       = materials.addMaterial(planks_maps);
+    unsigned wood_material         = materials.addMaterial(wood_maps);
+    unsigned metal_plates_material = materials.addMaterial(metal_plates_maps);
+
+    const unsigned demo_materials[] = {bricks_material, concrete_material, grass_material, plaster_material,
+                                       paint_wood_material, planks_material, wood_material, metal_plates_material};
+    for(unsigned material : demo_materials)
+    {
+        if(material == dgn::MaterialArray::INVALID_MATERIAL)
+        {
+            printf("material array is full, raise MAX_MATERIALS\n");
+            break;
+        }
+    }
+
+    materials.complete();
 
     skybox.loadAsCube("src/res/textures/skyboxday", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::SRGB);
     //skybox.loadFromDirectory("src/res/textures/skyboxnight/", dgn::TextureWrap::Repeat, dgn::TextureFilter::Trilinear, dgn::TextureStorage::SRGB);
 
-    shader.loadFromFiles("src/res/shaders/pbr_lite.vert", "", "src/res/shaders/pbr_lite.frag");
-    skin_shader.loadFromFiles("src/res/shaders/skin.vert", "", "src/res/shaders/skin.frag");
-
-    int shader_u_mvp        = shader.getUniformLocation("uMVP");
-    //int shader_u_norm_mat   = shader.getUniformLocation("uNormMat");
-    int shader_u_model_mat   = shader.getUniformLocation("uModelMat");
-    int shader_u_skybox   = shader.getUniformLocation("uSkybox");
-    int shader_u_irrad[2]   = {shader.getUniformLocation("uIrrad[0]"), shader.getUniformLocation("uIrrad[1]")};
-    int shader_u_texture   = shader.getUniformLocation("uTexture");
-    int shader_u_rough   = shader.getUniformLocation("uRough");
-    int shader_u_metal   = shader.getUniformLocation("uMetalness");
-    int shader_u_norm   = shader.getUniformLocation("uNorm");
-    int shader_u_ao        = shader.getUniformLocation("uAO");
-    int shader_u_cam_pos   = shader.getUniformLocation("uCamPos");
-
-    int shader_u_light_mat[SHADOW_CASCADES];
-    int shader_u_shadowmap[SHADOW_CASCADES];
-    int shader_u_cascade_depths[SHADOW_CASCADES];
+    skin_shader.finish();
 
-    for(int i = 0; i < SHADOW_CASCADES; i++)
-    {
-        shader_u_light_mat[i] = shader.getUniformLocation("uLightMat[" + std::to_string(i) + "]");
-        shader_u_shadowmap[i] = shader.getUniformLocation("uShadowMap[" + std::to_string(i) + "]");
-        shader_u_cascade_depths[i] = shader.getUniformLocation("uCascadeDepths[" + std::to_string(i) + "]");
-    }
+    // the pbr shader's uniforms are set through hashed handles, which skip values the program already holds
+    // and survive the R reload relinking it
+    using namespace dgn::literals;
 
-    int skin_u_mvp        = skin_shader.getUniformLocation("uMVP");
+    int skin_u_model      = skin_shader.getUniformLocation("uModel");
     int skin_u_norm_mat   = skin_shader.getUniformLocation("uNormMat");
     int skin_u_lut        = skin_shader.getUniformLocation("uLUT");
 
+    // Camera and cascade constants shared by the scene shaders, uploaded once per frame. The shaders declare
+    //     layout(std140) uniform Camera { mat4 uViewProj; mat4 uSkyViewProj; vec3 uCamPos; vec3 uSunDir; };
+    //     layout(std140) uniform Cascades { mat4 uLightMat[CASCADES]; float uCascadeDepths[CASCADES]; };
+    dgn::UniformLayout camera_layout;
+    unsigned camera_view_proj     = camera_layout.addMat4();
+    unsigned camera_sky_view_proj = camera_layout.addMat4();
+    unsigned camera_position      = camera_layout.addVec3();
+    unsigned camera_sun_dir       = camera_layout.addVec3();
+
+    dgn::UniformLayout cascade_layout;
+    dgn::UniformArray cascade_light_mats = cascade_layout.addMat4Array(SHADOW_CASCADES);
+    dgn::UniformArray cascade_depths     = cascade_layout.addFloatArray(SHADOW_CASCADES);
+
+    dgn::UniformBuffer camera_constants;
+    camera_constants.create(camera_layout);
+    dgn::UniformBuffer cascade_constants;
+    cascade_constants.create(cascade_layout);
+
+    shader.bindUniformBlock("Camera", CAMERA_BLOCK_BINDING).bindUniformBlock("Cascades", CASCADE_BLOCK_BINDING);
+    fallback_shader.bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+    skin_shader.bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+    skybox_shader.bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+    shadow_shader.bindUniformBlock("Cascades", CASCADE_BLOCK_BINDING);
+
+    main_window.getRenderer().bindUniformBuffer(camera_constants, CAMERA_BLOCK_BINDING);
+    main_window.getRenderer().bindUniformBuffer(cascade_constants, CASCADE_BLOCK_BINDING);
+
+
+    std::vector<unsigned> scene_materials = std::vector<unsigned>(scene.size());
+
+    scene_materials[0] = bricks_material;
+    scene_materials[1] = plaster_material;
+    scene_materials[2] = paint_wood_material;
+    scene_materials[3] = wood_material;
+    scene_materials[4] = grass_material;
+    scene_materials[5] = concrete_material;
+    scene_materials[6] = planks_material;
+    scene_materials[7] = bricks_material;
+
+    // per draw data read by gl_DrawIDARB, std430 layout
+    struct SceneDrawData
+    {
+        m3d::mat4x4 model;
+        unsigned material;
+        // bit i set when the mesh reaches cascade i, only read by the shadow pass
+        unsigned cascade_mask;
+        unsigned padding[2];
+    };
+
+    // every material lives in the same texture arrays and every cascade in the same layered framebuffer,
+    // so the scene and the shadow pass are one indirect draw each, refilled with the visible meshes every frame
+    dgn::DrawIndirectBuffer scene_draws;
+    dgn::DrawIndirectBuffer shadow_draws;
+
+    std::vector<SceneDrawData> scene_draw_data(scene.size());
 
-    std::vector<dgn::Texture*> textures = std::vector<dgn::Texture*>(scene.size());
+    dgn::RenderQueue scene_queue;
 
-    textures[0] = bricks_texture;
-    textures[1] = plaster_texture;
-    textures[2] = paint_wood_texture;
-    textures[3] = wood_texture;
-    textures[4] = grass_texture;
-    textures[5] = concrete_texture;
-    textures[6] = planks_texture;
-    textures[7] = bricks_texture;
+    dgn::CullingSet scene_culling;
+    std::vector<unsigned> scene_visible;
+    dgn::CullStats scene_cull_stats;
+    dgn::CullStats shadow_cull_stats[SHADOW_CASCADES];
+
+    // The cascades and the scene are culled and recorded on two workers, then replayed on the gl thread.
+    // The workers only read shared scene data, gl stays on this thread.
+    dgn::CommandList shadow_commands;
+    dgn::CommandList scene_commands;
+    std::vector<unsigned> shadow_visible[SHADOW_CASCADES];
+    std::vector<unsigned> shadow_masks(scene.size());
+
+    dgn::GpuProfiler gpu_profiler;
+    gpu_profiler.create();
+    main_window.getRenderer().setProfiler(&gpu_profiler);
+
+    scene_draws.create(scene.size(), sizeof(SceneDrawData));
+    shadow_draws.create(scene.size(), sizeof(SceneDrawData));
+
+    for(unsigned k = 0; k < scene.size(); k++)
+    {
+        scene_draw_data[k] = {m3d::mat4x4(1.0f), scene_materials[k], 0, {0, 0}};
+        scene_culling.add(scene[k].getBounds());
+    }
 
     dgn::Texture skin_lut;
     skin_lut.loadAs2D("src/res/textures/skin_lut.png", dgn::TextureWrap::ClampToEdge, dgn::TextureFilter::Bilinear, dgn::TextureStorage::SRGB);
@@ -264,6 +450,9 @@ int main(int argc, const char* argv[])
 
     dgn::Camera camera;
 
+    // the probe is baked once and kept for the whole run, so it has to see the real pbr program
+    shader.finish();
+
     #define R_PROBE_SIZE 256
     dgn::Texture reflection_probe_base;
     reflection_probe_base.createAsCube(nullptr, dgn::TextureData::Ubyte, R_PROBE_SIZE, R_PROBE_SIZE, dgn::TextureWrap::ClampToEdge, dgn::TextureFilter::Bilinear, dgn::TextureStorage::RGBA, dgn::TextureStorage::RGB);
@@ -313,35 +502,40 @@ int main(int argc, const char* argv[])
         main_window.getRenderer().setDepthTest(dgn::DepthTest::Less);
         main_window.getRenderer().setCullFace(dgn::Face::Back);
 
+        // the probe's sky is rendered without the sun
+        camera_constants.set(camera_view_proj, camera.getProjection() * camera.getView())
+                        .set(camera_sky_view_proj, camera.getProjection() * camera.getView().toMat3x3().toMat4x4())
+                        .set(camera_position, camera.position)
+                        .set(camera_sun_dir, m3d::vec3())
+                        .upload();
+
         main_window.getRenderer().bindShader(shader);
 
-        dgn::Shader::uniform(shader_u_mvp, camera.getProjection() * camera.getView());
-        //dgn::Shader::uniform(shader_u_norm_mat, m3d::mat3x3(1.0f));
-        dgn::Shader::uniform(shader_u_model_mat, m3d::mat4x4(1.0f));
-        dgn::Shader::uniform(shader_u_cam_pos, camera.position);
-        dgn::Shader::uniform(shader_u_texture, 0);
-        dgn::Shader::uniform(shader_u_rough, 1);
-        dgn::Shader::uniform(shader_u_metal, 2);
-        dgn::Shader::uniform(shader_u_norm, 3);
-        dgn::Shader::uniform(shader_u_ao, 4);
-        dgn::Shader::uniform(shader_u_skybox, 20);
-        dgn::Shader::uniform(shader_u_irrad[0], 18);
-        dgn::Shader::uniform(shader_u_irrad[1], 19);
+        //shader.uniform("uNormMat"_u, m3d::mat3x3(1.0f));
+        shader.uniform("uModelMat"_u, m3d::mat4x4(1.0f));
+        shader.uniform("uTexture"_u, 0);
+        shader.uniform("uRough"_u, 1);
+        shader.uniform("uMetalness"_u, 2);
+        shader.uniform("uNorm"_u, 3);
+        shader.uniform("uAO"_u, 4);
+        shader.uniform("uSkybox"_u, 20);
+        shader.uniform("uIrrad"_u[0], 18);
+        shader.uniform("uIrrad"_u[1], 19);
 
         main_window.getRenderer().bindTexture(skybox, 20);
         main_window.getRenderer().bindTexture(irrad_texture[0], 18);
         main_window.getRenderer().bindTexture(irrad_texture[1], 19);
 
-        int k = 0;
-        for(const dgn::Mesh& m : scene)
+        for(unsigned j = 0; j < dgn::MaterialArray::MAP_COUNT; j++)
         {
-            for(int j = 0; j < 5; j++)
-            {
-                main_window.getRenderer().bindTexture(textures[k][j], j);
+            main_window.getRenderer().bindTexture(materials.getMap((dgn::MaterialMap)j), j);
+        }
 
-            }
-            k++;
-            main_window.getRenderer().bindMesh(m);
+        for(unsigned k = 0; k < scene.size(); k++)
+        {
+            shader.uniform("uMaterial"_u, (int)scene_materials[k]);
+
+            main_window.getRenderer().bindMesh(scene[k]);
             main_window.getRenderer().drawBoundMesh();
         }
 
@@ -351,9 +545,7 @@ int main(int argc, const char* argv[])
         main_window.getRenderer().bindShader(skybox_shader);
         main_window.getRenderer().bindTexture(skybox, 0);
 
-        dgn::Shader::uniform(skybox_u_vp, camera.getProjection() * camera.getView().toMat3x3().toMat4x4());
         dgn::Shader::uniform(skybox_u_texture, 0);
-        dgn::Shader::uniform(skybox_u_sun_dir, m3d::vec3());
 
         main_window.getRenderer().drawBoundMesh();
 
@@ -361,8 +553,7 @@ int main(int argc, const char* argv[])
         ball_model2.translate(m3d::vec3(1.0f, 3.0f, 0.0f));
         main_window.getRenderer().bindShader(skin_shader);
 
-        dgn::Shader::uniform(skin_u_mvp, camera.getProjection() * camera.getView() * ball_model2);
-        //dgn::Shader::uniform(skin_u_model, ball_model2);
+        dgn::Shader::uniform(skin_u_model, ball_model2);
         dgn::Shader::uniform(skin_u_norm_mat, m3d::mat4x4(1.0f).toMat3x3());
         dgn::Shader::uniform(skin_u_lut, 0);
 
@@ -373,8 +564,7 @@ int main(int argc, const char* argv[])
     }
 
 
-    dgn::Shader reflection_probe_shader;
-    reflection_probe_shader.loadFromFiles("src/res/shaders/skybox.vert", "", "src/res/shaders/reflectionProbe.frag");
+    reflection_probe_shader.finish();
 
     int reflection_probe_u_vp        = reflection_probe_shader.getUniformLocation("uVP");
     int reflection_probe_u_texture   = reflection_probe_shader.getUniformLocation("uTexture");
@@ -459,16 +649,17 @@ int main(int argc, const char* argv[])
     line_mesh.createFromData(line_indices);
     line_mesh.complete();
 
-    dgn::Shader line_shader;
-    line_shader.loadFromFiles("src/res/shaders/line.vert", "", "src/res/shaders/line.frag");
+    line_shader.finish();
 
     int line_u_mvp = line_shader.getUniformLocation("uMVP");
     int line_u_points[2] = {line_shader.getUniformLocation("uPoints[0]"), line_shader.getUniformLocation("uPoints[1]")};
     int line_u_color = line_shader.getUniformLocation("uColor");
 
 
-    dgn::Shader color_lut_shader;
-    color_lut_shader.loadFromFiles("src/res/shaders/3d_texture.vert", "", "src/res/shaders/3d_texture.frag");
+    color_lut_shader.finish();
+
+    dgn::ProgramCacheStats program_cache_stats = dgn::Shader::getProgramCacheStats();
+    printf("program cache: %u hits, %u misses, %u stale\n", program_cache_stats.hits, program_cache_stats.misses, program_cache_stats.stale);
 
     int color_u_mvp = color_lut_shader.getUniformLocation("uMVP");
     int color_u_texture = color_lut_shader.getUniformLocation("uTexture");
@@ -479,198 +670,346 @@ int main(int argc, const char* argv[])
     dgn::Texture lut_texture;
     lut_texture.loadAs3D("src/res/textures/3d_lut_colored.png", 16, dgn::TextureWrap::ClampToEdge, dgn::TextureFilter::Bilinear, dgn::TextureStorage::RGB, 0.0f);
 
-    /////////////////////////////////////////////////////////
-    //                      MAIN LOOP                      //
-    /////////////////////////////////////////////////////////
+    // written by this thread before the workers are kicked, read by them until they are waited on
+    m3d::mat4x4 ball_model;
+    m3d::mat4x4 ball_model2;
+    m3d::mat4x4 mvp;
 
-    while(!main_window.shouldClose())
+    FrameWorker shadow_worker([&]()
     {
-        main_window.getInput().pollEvents();
+        DGN_PROFILE_SCOPE("ShadowRecord");
 
-        updateCamera(&camera, &main_window, 1.0f / 60.0f, CONTROLLER);
+        shadowmap.updateViewMat(sun_dir);
+        shadowmap.updateProjectionMatsFitted(camera, cascade_distances, 10.0f, 1.0f / PI);
 
-        if(main_window.getInput().getKeyDown(dgn::Key::R))
+        unsigned render_mask = shadowmap.selectCascades();
+
+        shadow_commands.reset();
+        if(!render_mask) return;
+
+        std::fill(shadow_masks.begin(), shadow_masks.end(), 0);
+        for(int i = 0; i < SHADOW_CASCADES; i++)
         {
-            shader.loadFromFiles("src/res/shaders/pbr_lite.vert", "", "src/res/shaders/pbr_lite.frag");
-            skin_shader.loadFromFiles("src/res/shaders/skin.vert", "", "src/res/shaders/skin.frag");
-            screen_shader.loadFromFiles("src/res/shaders/screen.vert", "", "src/res/shaders/screen.frag");
-            skybox_shader.loadFromFiles("src/res/shaders/skybox.vert", "", "src/res/shaders/skybox.frag");
-            skin_lut.loadAs2D("src/res/textures/skin_lut.png", dgn::TextureWrap::ClampToEdge, dgn::TextureFilter::Bilinear, dgn::TextureStorage::SRGB);
-            lut_texture.loadAs3D("src/res/textures/3d_lut_colored.png", 16, dgn::TextureWrap::ClampToEdge, dgn::TextureFilter::Bilinear, dgn::TextureStorage::RGB, 0.0f);
-        }
+            if(!(render_mask & (1u << i))) continue;
 
+            // casters outside the cascade's ortho volume never reach its layer
+            shadow_cull_stats[i] = scene_culling.cull(shadowmap.getFrustum(i), shadow_visible[i]);
+            for(unsigned k : shadow_visible[i])
+            {
+                shadow_masks[k] |= 1u << i;
+            }
+        }
 
-        if(main_window.getInput().getKeyDown(dgn::Key::P))
+        // one draw per caster, the geometry shader only emits it to the cascades in its mask
+        shadow_draws.clear();
+        for(unsigned k = 0; k < scene.size(); k++)
         {
-            printf("%f, %f, %f\n", camera.position.x, camera.position.y, camera.position.z);
+            if(!shadow_masks[k]) continue;
+
+            SceneDrawData data = scene_draw_data[k];
+            data.cascade_mask = shadow_masks[k];
+            shadow_draws.addDraw(scene[k], &data);
         }
 
+        // cached layers keep their depth, so only the selected ones are cleared
         for(int i = 0; i < SHADOW_CASCADES; i++)
         {
-            shadowmap[i].updateProjectionMatFitted(camera, cascade_distances[i], cascade_distances[i+1], 10.0f, 1.0f / PI);
-            shadowmap[i].updateViewMat(sun_dir);
+            if(!(render_mask & (1u << i))) continue;
+
+            shadow_commands.bindFramebuffer(shadowmap.getLayerFramebuffer(i));
+            shadow_commands.clear();
         }
 
-        m3d::mat4x4 mvp = camera.getProjection() * camera.getView();
+        shadow_commands.bindFramebuffer(shadowmap.getFramebuffer());
 
-        m3d::mat4x4 ball_model = m3d::mat4x4(1.0f);
-        ball_model.translate(m3d::vec3(-1.0f, 3.0f, 0.0f));
+        shadow_commands.uniform(shadow_u_cascade_mask, 0);
+        shadow_commands.uniform(shadow_u_model, m3d::mat4x4(1.0f));
 
-        m3d::mat4x4 ball_model2 = m3d::mat4x4(1.0f);
-        ball_model2.translate(m3d::vec3(1.0f, 3.0f, 0.0f));
+        shadow_commands.drawIndirect(shadow_draws);
 
-        ///////////////////////////////////////////////////////
-        //                  RENDER SHADOWS                   //
-        ///////////////////////////////////////////////////////
-
-        //TODO: make shadows work in zero to one depth space
-        main_window.getRenderer().setClipMode(dgn::ClipMode::NegativeOneToOne);
-        main_window.getRenderer().setDepthTest(dgn::DepthTest::Less);
-        main_window.getRenderer().setCullFace(dgn::Face::Front);
-        main_window.getRenderer().setViewport(0, 0, SHADOW_SIZE, SHADOW_SIZE);
+        shadow_commands.uniform(shadow_u_cascade_mask, (int)render_mask);
+        shadow_commands.uniform(shadow_u_model, ball_model);
 
-        main_window.getRenderer().bindShader(shadow_shader);
+        shadow_commands.bindMesh(ball);
+        shadow_commands.drawBoundMesh();
+        shadow_commands.uniform(shadow_u_model, ball_model2);
+        shadow_commands.drawBoundMesh();
+    });
 
-        for(int i = 0; i < SHADOW_CASCADES; i++)
+    FrameWorker scene_worker([&]()
+    {
         {
-            main_window.getRenderer().bindFramebuffer(shadowmap[i].getFramebuffer());
-            main_window.getRenderer().clear();
+            DGN_PROFILE_SCOPE("SceneCull");
+
+            scene_cull_stats = scene_culling.cull(camera.getFrustum(), scene_visible);
 
-            dgn::Shader::uniform(shadow_u_light, shadowmap[i].getLightMat());
-            dgn::Shader::uniform(shadow_u_model, m3d::mat4x4(1.0f));
+            // sorted front to back, materials no longer split the draw
+            scene_queue.clear();
+            scene_queue.setViewPosition(camera.position);
+            for(unsigned k : scene_visible)
+            {
+                dgn::RenderItem item;
+                item.mesh = &scene[k];
+                item.shader = &shader;
+                item.user = k;
+
+                scene_queue.submit(0, item);
+            }
+            scene_queue.sort();
 
-            for(const dgn::Mesh& m : scene)
+            scene_draws.clear();
+            for(unsigned q = 0; q < scene_queue.size(); q++)
             {
-                main_window.getRenderer().bindMesh(m);
-                main_window.getRenderer().drawBoundMesh();
+                unsigned k = scene_queue.getItem(q).user;
+                scene_draws.addDraw(scene[k], &scene_draw_data[k]);
             }
+        }
 
-            dgn::Shader::uniform(shadow_u_model, ball_model);
+        DGN_PROFILE_SCOPE("SceneRecord");
 
-            main_window.getRenderer().bindMesh(ball);
-            main_window.getRenderer().drawBoundMesh();
-            dgn::Shader::uniform(shadow_u_model, ball_model2);
-            main_window.getRenderer().drawBoundMesh();
+        scene_commands.reset();
+
+        scene_commands.setClipMode(dgn::ClipMode::ZeroToOne);
+        scene_commands.setDepthTest(dgn::DepthTest::Less);
+        scene_commands.setCullFace(dgn::Face::Back);
+        scene_commands.bindFramebuffer(screen_fb);
+        scene_commands.setViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+        scene_commands.clear();
+
+        scene_commands.bindShader(shader);
+
+        //scene_commands.uniform(shader, "uNormMat"_u, m3d::mat3x3(1.0f));
+        scene_commands.uniform(shader, "uModelMat"_u, m3d::mat4x4(1.0f));
+        scene_commands.uniform(shader, "uTexture"_u, 0);
+        scene_commands.uniform(shader, "uRough"_u, 1);
+        scene_commands.uniform(shader, "uMetalness"_u, 2);
+        scene_commands.uniform(shader, "uNorm"_u, 3);
+        scene_commands.uniform(shader, "uAO"_u, 4);
+        scene_commands.uniform(shader, "uSkybox"_u, 20);
+        scene_commands.uniform(shader, "uIrrad"_u[0], 18);
+        scene_commands.uniform(shader, "uIrrad"_u[1], 19);
+
+        scene_commands.uniform(shader, "uShadowMap"_u, 21);
+        scene_commands.bindTexture(shadowmap.getTexture(), 21);
+
+        scene_commands.bindTexture(skybox_probe, 20);
+        //scene_commands.bindTexture(reflection_probe, 20);
+        scene_commands.bindTexture(irrad_texture[0], 18);
+        scene_commands.bindTexture(irrad_texture[1], 19);
+
+        for(unsigned j = 0; j < dgn::MaterialArray::MAP_COUNT; j++)
+        {
+            scene_commands.bindTexture(materials.getMap((dgn::MaterialMap)j), j);
         }
 
-        main_window.getRenderer().unbindFramebuffer();
+        // -1 reads the material from the draw data
+        scene_commands.uniform(shader, "uMaterial"_u, -1);
+        scene_commands.drawIndirect(scene_draws);
 
-        /////////////////////////////////////////////////////////
-        //                  RENDER SCENE                       //
-        /////////////////////////////////////////////////////////
+        scene_commands.uniform(shader, "uModelMat"_u, ball_model);
+        scene_commands.uniform(shader, "uMaterial"_u, (int)metal_plates_material);
 
-        main_window.getRenderer().setClipMode(dgn::ClipMode::ZeroToOne);
-        main_window.getRenderer().setDepthTest(dgn::DepthTest::Less);
-        main_window.getRenderer().setCullFace(dgn::Face::Back);
-        main_window.getRenderer().bindFramebuffer(screen_fb);
-        main_window.getRenderer().setViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
-        main_window.getRenderer().clear();
+        scene_commands.bindTexture(reflection_probe, 20);
+        scene_commands.bindMesh(ball);
+        scene_commands.drawBoundMesh();
 
-        main_window.getRenderer().bindShader(shader);
+        scene_commands.bindShader(skin_shader);
 
-        dgn::Shader::uniform(shader_u_mvp, mvp);
-        //dgn::Shader::uniform(shader_u_norm_mat, m3d::mat3x3(1.0f));
-        dgn::Shader::uniform(shader_u_model_mat, m3d::mat4x4(1.0f));
-        dgn::Shader::uniform(shader_u_cam_pos, camera.position);
-        dgn::Shader::uniform(shader_u_texture, 0);
-        dgn::Shader::uniform(shader_u_rough, 1);
-        dgn::Shader::uniform(shader_u_metal, 2);
-        dgn::Shader::uniform(shader_u_norm, 3);
-        dgn::Shader::uniform(shader_u_ao, 4);
-        dgn::Shader::uniform(shader_u_skybox, 20);
-        dgn::Shader::uniform(shader_u_irrad[0], 18);
-        dgn::Shader::uniform(shader_u_irrad[1], 19);
+        scene_commands.uniform(skin_u_model, ball_model2);
+        scene_commands.uniform(skin_u_norm_mat, m3d::mat4x4(1.0f).toMat3x3());
+        scene_commands.uniform(skin_u_lut, 0);
 
-        for(int i = 0; i < SHADOW_CASCADES; i++)
+        scene_commands.bindTexture(skin_lut, 0);
+
+        scene_commands.drawBoundMesh();
+
+
+        scene_commands.bindShader(color_lut_shader);
+        scene_commands.bindTexture(lut_texture, 0);
+
+        scene_commands.uniform(color_u_mvp, mvp * m3d::mat4x4(1.0f).translate(m3d::vec3(0.0f, 5.0f, -3.0f)));
+        scene_commands.uniform(color_u_texture, 0);
+
+        scene_commands.bindMesh(unit_cube);
+
+        scene_commands.drawBoundMesh();
+    });
+
+    /////////////////////////////////////////////////////////
+    //                      MAIN LOOP                      //
+    /////////////////////////////////////////////////////////
+
+    while(!main_window.shouldClose())
+    {
+        DGN_PROFILE_SCOPE("Frame");
+
+        main_window.getInput().pollEvents();
+
+        updateCamera(&camera, &main_window, 1.0f / 60.0f, CONTROLLER);
+
+        if(main_window.getInput().getKeyDown(dgn::Key::R))
         {
-            dgn::Shader::uniform(shader_u_light_mat[i], shadowmap[i].getLightMat());
-            dgn::Shader::uniform(shader_u_shadowmap[i], 21 + i);
-            main_window.getRenderer().bindTexture(shadowmap[i].getTexture(), 21 + i);
+            // the old programs keep drawing until the new ones are ready
+            shader.loadFromFilesAsync("src/res/shaders/pbr_lite.vert", "", "src/res/shaders/pbr_lite.frag");
+            skin_shader.loadFromFilesAsync("src/res/shaders/skin.vert", "", "src/res/shaders/skin.frag");
+            screen_shader.loadFromFilesAsync("src/res/shaders/screen.vert", "", "src/res/shaders/screen.frag");
+            skybox_shader.loadFromFilesAsync("src/res/shaders/skybox.vert", "", "src/res/shaders/skybox.frag");
 
-            m3d::vec4 v = m3d::vec4(0.0f, 0.0f, -cascade_distances[i + 1], 1.0f);
-            float clip = (camera.getProjection() * v).z;
-            dgn::Shader::uniform(shader_u_cascade_depths[i], clip);
+            program_cache_stats = dgn::Shader::getProgramCacheStats();
+            printf("program cache: %u hits, %u misses, %u stale\n", program_cache_stats.hits, program_cache_stats.misses, program_cache_stats.stale);
+
+            skin_lut.loadAs2D("src/res/textures/skin_lut.png", dgn::TextureWrap::ClampToEdge, dgn::TextureFilter::Bilinear, dgn::TextureStorage::SRGB);
+            lut_texture.loadAs3D("src/res/textures/3d_lut_colored.png", 16, dgn::TextureWrap::ClampToEdge, dgn::TextureFilter::Bilinear, dgn::TextureStorage::RGB, 0.0f);
         }
 
-        main_window.getRenderer().bindTexture(skybox_probe, 20);
-        //main_window.getRenderer().bindCubemap(reflection_probe, 20);
-        main_window.getRenderer().bindTexture(irrad_texture[0], 18);
-        main_window.getRenderer().bindTexture(irrad_texture[1], 19);
+        // reloaded programs are swapped in here, while the workers are idle. Until then the previous
+        // program keeps drawing.
+        shader.isReady();
+        skin_shader.isReady();
+        screen_shader.isReady();
+        skybox_shader.isReady();
+
+        if(main_window.getInput().getKeyDown(dgn::Key::P))
+        {
+            printf("%f, %f, %f\n", camera.position.x, camera.position.y, camera.position.z);
+        }
 
-        int i = 0;
-        for(const dgn::Mesh& m : scene)
+        if(main_window.getInput().getKeyDown(dgn::Key::C))
         {
-            for(int j = 0; j < 5; j++)
+            printf("scene: %u drawn, %u culled\n", scene_cull_stats.drawn, scene_cull_stats.culled);
+            for(int i = 0; i < SHADOW_CASCADES; i++)
             {
-                main_window.getRenderer().bindTexture(textures[i][j], j);
+                printf("cascade %d: %u drawn, %u culled\n", i, shadow_cull_stats[i].drawn, shadow_cull_stats[i].culled);
+            }
+            printf("cascade renders skipped: %u\n", shadowmap.getSkippedRenders());
+            shadowmap.resetSkippedRenders();
+
+            const dgn::RenderStateStats& state_stats = main_window.getRenderer().getStateStats();
+            printf("state changes: %u issued, %u elided\n", state_stats.issued, state_stats.elided);
+        }
 
+        if(main_window.getInput().getKeyDown(dgn::Key::G))
+        {
+            for(unsigned i = 0; i < gpu_profiler.getScopeCount(); i++)
+            {
+                dgn::GpuTimingStats stats = gpu_profiler.getStats(i);
+                printf("%s: %.3f ms avg, %.3f ms p95, %.3f ms p99\n", gpu_profiler.getScopeName(i), stats.average, stats.p95, stats.p99);
             }
-            i++;
-            main_window.getRenderer().bindMesh(m);
-            main_window.getRenderer().drawBoundMesh();
+
+            gpu_profiler.writeCSV("gpu_profile.csv");
+            gpu_profiler.writeJSON("gpu_profile.json");
         }
 
-        for(int j = 0; j < 5; j++)
+        if(main_window.getInput().getKeyDown(dgn::Key::T))
         {
-            main_window.getRenderer().bindTexture(metal_plates_texture[j], j);
+            dgn::writeCpuTrace("cpu_trace.json");
         }
 
-        dgn::Shader::uniform(shader_u_mvp, mvp * ball_model);
-        dgn::Shader::uniform(shader_u_model_mat, ball_model);
-        //main_window.getRenderer().bindTexture(black_texture, 2);
-        //main_window.getRenderer().bindTexture(white_texture, 1);
-        //main_window.getRenderer().bindTexture(white_texture, 0);
+        main_window.getRenderer().resetStateStats();
+        gpu_profiler.beginFrame();
 
-        main_window.getRenderer().bindTexture(reflection_probe, 20);
-        main_window.getRenderer().bindMesh(ball);
-        main_window.getRenderer().drawBoundMesh();
+        ball_model = m3d::mat4x4(1.0f);
+        ball_model.translate(m3d::vec3(-1.0f, 3.0f, 0.0f));
 
-        main_window.getRenderer().bindShader(skin_shader);
+        ball_model2 = m3d::mat4x4(1.0f);
+        ball_model2.translate(m3d::vec3(1.0f, 3.0f, 0.0f));
 
-        dgn::Shader::uniform(skin_u_mvp, mvp * ball_model2);
-        //dgn::Shader::uniform(skin_u_model, ball_model2);
-        dgn::Shader::uniform(skin_u_norm_mat, m3d::mat4x4(1.0f).toMat3x3());
-        dgn::Shader::uniform(skin_u_lut, 0);
+        mvp = camera.getProjection() * camera.getView();
 
-        main_window.getRenderer().bindTexture(skin_lut, 0);
+        shadow_worker.kick();
+        scene_worker.kick();
 
-        main_window.getRenderer().drawBoundMesh();
+        camera_constants.set(camera_view_proj, mvp)
+                        .set(camera_sky_view_proj, camera.getProjection() * camera.getView().toMat3x3().toMat4x4())
+                        .set(camera_position, camera.position)
+                        .set(camera_sun_dir, sun_dir)
+                        .upload();
+
+        {
+            DGN_PROFILE_SCOPE("RecordJoin");
 
+            shadow_worker.wait();
+            scene_worker.wait();
+            shadow_draws.upload();
+            scene_draws.upload();
+        }
 
-        main_window.getRenderer().bindShader(color_lut_shader);
-        main_window.getRenderer().bindTexture(lut_texture, 0);
+        for(int i = 0; i < SHADOW_CASCADES; i++)
+        {
+            m3d::vec4 v = m3d::vec4(0.0f, 0.0f, -cascade_distances[i + 1], 1.0f);
+            float clip = (camera.getProjection() * v).z;
 
-        dgn::Shader::uniform(color_u_mvp, mvp * m3d::mat4x4(1.0f).translate(m3d::vec3(0.0f, 5.0f, -3.0f)));
-        dgn::Shader::uniform(color_u_texture, 0);
+            cascade_constants.set(cascade_light_mats.element(i), shadowmap.getLightMat(i));
+            cascade_constants.set(cascade_depths.element(i), clip);
+        }
+        cascade_constants.upload();
 
-        main_window.getRenderer().bindMesh(unit_cube);
+        ///////////////////////////////////////////////////////
+        //                  RENDER SHADOWS                   //
+        ///////////////////////////////////////////////////////
 
-        main_window.getRenderer().drawBoundMesh();
+        {
+            DGN_PROFILE_SCOPE("ShadowSubmit");
+
+            main_window.getRenderer().beginRegion("shadows");
+
+            //TODO: make shadows work in zero to one depth space
+            main_window.getRenderer().setClipMode(dgn::ClipMode::NegativeOneToOne);
+            main_window.getRenderer().setDepthTest(dgn::DepthTest::Less);
+            main_window.getRenderer().setCullFace(dgn::Face::Front);
+            main_window.getRenderer().setViewport(0, 0, SHADOW_SIZE, SHADOW_SIZE);
+
+            main_window.getRenderer().bindShader(shadow_shader);
+
+            main_window.getRenderer().execute(shadow_commands);
+
+            main_window.getRenderer().unbindFramebuffer();
+            main_window.getRenderer().endRegion();
+        }
+
+        /////////////////////////////////////////////////////////
+        //                  RENDER SCENE                       //
+        /////////////////////////////////////////////////////////
 
-        main_window.getRenderer().unbindMesh();
-        main_window.getRenderer().unbindTexture(0);
-        main_window.getRenderer().unbindShader();
+        {
+            DGN_PROFILE_SCOPE("SceneSubmit");
+
+            main_window.getRenderer().beginRegion("pbr");
+
+            main_window.getRenderer().execute(scene_commands);
 
+            main_window.getRenderer().unbindMesh();
+            main_window.getRenderer().unbindTexture(0);
+            main_window.getRenderer().unbindShader();
+
+            main_window.getRenderer().endRegion();
+        }
 
         /////////////////////////////////////////////
         //              RENDER CUBEMAP             //
         /////////////////////////////////////////////
 
-        main_window.getRenderer().setDepthTest(dgn::DepthTest::LEqual);
+        {
+            DGN_PROFILE_SCOPE("SkyboxSubmit");
 
-        main_window.getRenderer().bindMesh(skybox_mesh);
-        main_window.getRenderer().bindShader(skybox_shader);
-        main_window.getRenderer().bindTexture(skybox, 0);
+            main_window.getRenderer().beginRegion("skybox");
 
-        dgn::Shader::uniform(skybox_u_vp, camera.getProjection() * camera.getView().toMat3x3().toMat4x4());
-        dgn::Shader::uniform(skybox_u_texture, 0);
-        dgn::Shader::uniform(skybox_u_sun_dir, sun_dir);
+            main_window.getRenderer().setDepthTest(dgn::DepthTest::LEqual);
 
-        //dgn::Shader::uniform(reflection_probe_u_vp, camera.getProjection() * camera.getView().toMat3x3().toMat4x4());
-        //dgn::Shader::uniform(reflection_probe_u_texture, 0);
-        //dgn::Shader::uniform(reflection_probe_u_roughness, main_window.getInput().getGamepadAxis(0, dgn::GamepadAxis::LeftX, 0.1f));
+            main_window.getRenderer().bindMesh(skybox_mesh);
+            main_window.getRenderer().bindShader(skybox_shader);
+            main_window.getRenderer().bindTexture(skybox, 0);
 
-        main_window.getRenderer().drawBoundMesh();
+            dgn::Shader::uniform(skybox_u_texture, 0);
+
+            //dgn::Shader::uniform(reflection_probe_u_vp, camera.getProjection() * camera.getView().toMat3x3().toMat4x4());
+            //dgn::Shader::uniform(reflection_probe_u_texture, 0);
+            //dgn::Shader::uniform(reflection_probe_u_roughness, main_window.getInput().getGamepadAxis(0, dgn::GamepadAxis::LeftX, 0.1f));
+
+            main_window.getRenderer().drawBoundMesh();
+
+            main_window.getRenderer().endRegion();
+        }
 
         /////////////////////////////////////////////
         //            RENDER COLLIDERS             //
@@ -678,101 +1017,118 @@ int main(int argc, const char* argv[])
 
         //main_window.getRenderer().setDepthTest(dgn::DepthTest::Always);
 
-        main_window.getRenderer().setDrawMode(dgn::DrawMode::Lines);
-        //main_window.getRenderer().setDrawMode(dgn::DrawMode::Triangles);
+        {
+            DGN_PROFILE_SCOPE("ColliderSubmit");
 
-        main_window.getRenderer().bindMesh(line_mesh);
-        main_window.getRenderer().bindShader(line_shader);
-        dgn::Shader::uniform(line_u_mvp, camera.getProjection() * camera.getView());
+            main_window.getRenderer().beginRegion("colliders");
 
-        std::vector<tgr::Collider*> colliders;
+            main_window.getRenderer().setDrawMode(dgn::DrawMode::Lines);
+            //main_window.getRenderer().setDrawMode(dgn::DrawMode::Triangles);
 
-        m3d::vec3 test_collider_pos = camera.position + m3d::vec3(0.0f, 0.0f, -1.0f) * camera.rotation;
-        tgr::Sphere test_collider = tgr::Sphere(test_collider_pos, 0.2f);
-        //tgr::AABB test_collider = tgr::AABB(test_collider_pos + m3d::vec3(0.2), test_collider_pos - m3d::vec3(0.2));
-        //tgr::Plane test_collider = tgr::Plane(m3d::vec3(0.0f, 1.0f, 0.0f), test_collider_pos.y);
-//        dgn::Triangle test_collider = dgn::Triangle(test_collider_pos + m3d::vec3(-0.5f, -0.5f, 0.0f),
-//                                                    test_collider_pos + m3d::vec3(0.0f, 0.5f, 0.0f),
-//                                                    test_collider_pos + m3d::vec3(0.5f, -0.5f, 0.0f));
+            main_window.getRenderer().bindMesh(line_mesh);
+            main_window.getRenderer().bindShader(line_shader);
+            dgn::Shader::uniform(line_u_mvp, camera.getProjection() * camera.getView());
 
-        tgr::AABB box1 = tgr::AABB(m3d::vec3(0.5f, 2.5f, 5.5f), m3d::vec3(-0.5f, 1.5f, 4.5f)).normalize();
-        tgr::Sphere sphere1 = tgr::Sphere(m3d::vec3(1.0f, 3.0f, 2.0f), 0.5f);
-        tgr::Plane plane1 = tgr::Plane(m3d::vec3(0.0f, 1.0f, 0.0f), 1.0f);
-        //dgn::Triangle tri1 = dgn::Triangle(m3d::vec3(0.0f, 1.5f, 2.5f), m3d::vec3(0.0f, 2.5f, 3.0f), m3d::vec3(0.0f, 1.5f, 3.5f));
+            std::vector<tgr::Collider*> colliders;
 
-        colliders.push_back(&box1);
-        colliders.push_back(&sphere1);
-        colliders.push_back(&plane1);
-        //colliders.push_back(&tri1);
-        colliders.push_back(&test_collider);
+            m3d::vec3 test_collider_pos = camera.position + m3d::vec3(0.0f, 0.0f, -1.0f) * camera.rotation;
+            tgr::Sphere test_collider = tgr::Sphere(test_collider_pos, 0.2f);
+            //tgr::AABB test_collider = tgr::AABB(test_collider_pos + m3d::vec3(0.2), test_collider_pos - m3d::vec3(0.2));
+            //tgr::Plane test_collider = tgr::Plane(m3d::vec3(0.0f, 1.0f, 0.0f), test_collider_pos.y);
+    //        dgn::Triangle test_collider = dgn::Triangle(test_collider_pos + m3d::vec3(-0.5f, -0.5f, 0.0f),
+    //                                                    test_collider_pos + m3d::vec3(0.0f, 0.5f, 0.0f),
+    //                                                    test_collider_pos + m3d::vec3(0.5f, -0.5f, 0.0f));
 
-        for(unsigned i = 0; i < colliders.size(); i++)
-        {
-            dgn::Shader::uniform(line_u_color, m3d::vec3(0.0f, 1.0f, 0.0f));
+            tgr::AABB box1 = tgr::AABB(m3d::vec3(0.5f, 2.5f, 5.5f), m3d::vec3(-0.5f, 1.5f, 4.5f)).normalize();
+            tgr::Sphere sphere1 = tgr::Sphere(m3d::vec3(1.0f, 3.0f, 2.0f), 0.5f);
+            tgr::Plane plane1 = tgr::Plane(m3d::vec3(0.0f, 1.0f, 0.0f), 1.0f);
+            //dgn::Triangle tri1 = dgn::Triangle(m3d::vec3(0.0f, 1.5f, 2.5f), m3d::vec3(0.0f, 2.5f, 3.0f), m3d::vec3(0.0f, 1.5f, 3.5f));
 
-            for(unsigned j = i + 1; j < colliders.size(); j++)
+            colliders.push_back(&box1);
+            colliders.push_back(&sphere1);
+            colliders.push_back(&plane1);
+            //colliders.push_back(&tri1);
+            colliders.push_back(&test_collider);
+
+            for(unsigned i = 0; i < colliders.size(); i++)
             {
-                if(colliders[i]->checkCollision(colliders[j]).hit)
+                dgn::Shader::uniform(line_u_color, m3d::vec3(0.0f, 1.0f, 0.0f));
+
+                for(unsigned j = i + 1; j < colliders.size(); j++)
                 {
-                    dgn::Shader::uniform(line_u_color, m3d::vec3(1.0f, 0.0f, 0.0f));
+                    if(colliders[i]->checkCollision(colliders[j]).hit)
+                    {
+                        dgn::Shader::uniform(line_u_color, m3d::vec3(1.0f, 0.0f, 0.0f));
+                    }
                 }
-            }
 
-            switch(colliders[i]->getType())
-            {
-            case tgr::ColliderType::AABB:
-                drawLineBox(*(tgr::AABB*)colliders[i], line_u_points, main_window.getRenderer());
-                break;
-            case tgr::ColliderType::Sphere:
-                    drawLineSphere(*(tgr::Sphere*)colliders[i], line_u_points, main_window.getRenderer());
-                break;
-            case tgr::ColliderType::Plane:
-                    drawPlane(*(tgr::Plane*)colliders[i], line_u_points, main_window.getRenderer());
-                break;
-            case tgr::ColliderType::Triangle:
-                    //drawTriangle(*(dgn::Triangle*)colliders[i], line_u_points, main_window.getRenderer());
-                break;
-            default:
-                break;
+                switch(colliders[i]->getType())
+                {
+                case tgr::ColliderType::AABB:
+                    drawLineBox(*(tgr::AABB*)colliders[i], line_u_points, main_window.getRenderer());
+                    break;
+                case tgr::ColliderType::Sphere:
+                        drawLineSphere(*(tgr::Sphere*)colliders[i], line_u_points, main_window.getRenderer());
+                    break;
+                case tgr::ColliderType::Plane:
+                        drawPlane(*(tgr::Plane*)colliders[i], line_u_points, main_window.getRenderer());
+                    break;
+                case tgr::ColliderType::Triangle:
+                        //drawTriangle(*(dgn::Triangle*)colliders[i], line_u_points, main_window.getRenderer());
+                    break;
+                default:
+                    break;
+                }
             }
-        }
 
-        dgn::Shader::uniform(line_u_color, m3d::vec3(1.0f, 1.0f, 0.0f));
-        m3d::vec3 near_point = sphere1.nearestPoint(camera.position);
-        drawPoint(near_point, line_u_points, main_window.getRenderer());
+            dgn::Shader::uniform(line_u_color, m3d::vec3(1.0f, 1.0f, 0.0f));
+            m3d::vec3 near_point = sphere1.nearestPoint(camera.position);
+            drawPoint(near_point, line_u_points, main_window.getRenderer());
 
-        near_point = box1.nearestPoint(camera.position);
-        drawPoint(near_point, line_u_points, main_window.getRenderer());
+            near_point = box1.nearestPoint(camera.position);
+            drawPoint(near_point, line_u_points, main_window.getRenderer());
 
-        near_point = plane1.nearestPoint(camera.position);
-        drawPoint(near_point, line_u_points, main_window.getRenderer());
+            near_point = plane1.nearestPoint(camera.position);
+            drawPoint(near_point, line_u_points, main_window.getRenderer());
 
-        //near_point = tri1.nearestPoint(camera.position);
-        //drawPoint(near_point, line_u_points, main_window.getRenderer());
+            //near_point = tri1.nearestPoint(camera.position);
+            //drawPoint(near_point, line_u_points, main_window.getRenderer());
 
-        main_window.getRenderer().unbindShader();
-        main_window.getRenderer().unbindMesh();
+            main_window.getRenderer().unbindShader();
+            main_window.getRenderer().unbindMesh();
 
-        main_window.getRenderer().setDrawMode(dgn::DrawMode::Triangles);
+            main_window.getRenderer().setDrawMode(dgn::DrawMode::Triangles);
+
+            main_window.getRenderer().endRegion();
+        }
 
         //////////////////////////////////////////////
         //                RENDER SCREEN             //
         //////////////////////////////////////////////
-        main_window.getRenderer().unbindFramebuffer();
-        main_window.getRenderer().clear();
-        main_window.getRenderer().setDepthTest(dgn::DepthTest::Always);
+        {
+            DGN_PROFILE_SCOPE("ScreenSubmit");
 
-        main_window.getRenderer().bindShader(screen_shader);
+            main_window.getRenderer().beginRegion("screen");
+            main_window.getRenderer().unbindFramebuffer();
+            main_window.getRenderer().clear();
+            main_window.getRenderer().setDepthTest(dgn::DepthTest::Always);
 
-        main_window.getRenderer().bindTexture(screen_texture, 0);
-        main_window.getRenderer().bindTexture(lut_texture, 1);
-        //main_window.getRenderer().bindTexture(shadowmap.getTexture(), 0);
+            main_window.getRenderer().bindShader(screen_shader);
 
-        dgn::Shader::uniform(screen_u_texture, 0);
-        dgn::Shader::uniform(screen_u_color_lut, 1);
+            main_window.getRenderer().bindTexture(screen_texture, 0);
+            main_window.getRenderer().bindTexture(lut_texture, 1);
+            //main_window.getRenderer().bindTexture(shadowmap.getTexture(), 0);
 
-        main_window.getRenderer().bindMesh(screen_mesh);
-        main_window.getRenderer().drawBoundMesh();
+            dgn::Shader::uniform(screen_u_texture, 0);
+            dgn::Shader::uniform(screen_u_color_lut, 1);
+
+            main_window.getRenderer().bindMesh(screen_mesh);
+            main_window.getRenderer().drawBoundMesh();
+
+            main_window.getRenderer().endRegion();
+        }
+
+        gpu_profiler.endFrame();
 
         //main_window.getRenderer().setViewport(0, WINDOW_HEIGHT - WINDOW_HEIGHT / 4, WINDOW_WIDTH / 4, WINDOW_HEIGHT / 4);
 
@@ -786,17 +1142,98 @@ int main(int argc, const char* argv[])
     {
         m.dispose();
     }
+    scene_draws.dispose();
+    shadow_draws.dispose();
+    shadowmap.dispose();
+    scene_arena.dispose();
+    gpu_profiler.dispose();
+    camera_constants.dispose();
+    cascade_constants.dispose();
 
     shader.dispose();
+    fallback_shader.dispose();
     skybox.dispose();
+    materials.dispose();
 
     main_window.terminate();
 }
 
+void benchmarkMeshCache(dgn::Window *window, const char *filepath)
+{
+    std::remove((std::string(filepath) + ".dmesh").c_str());
+
+    double start = window->getTime();
+    dgn::Model cold = dgn::Mesh::loadFromFile(filepath);
+    double cold_time = window->getTime() - start;
+
+    start = window->getTime();
+    dgn::Model warm = dgn::Mesh::loadFromFile(filepath);
+    double warm_time = window->getTime() - start;
+
+    printf("MESH CACHE %s\n\tcold: %.3f ms\n\twarm: %.3f ms\n", filepath, cold_time * 1000.0, warm_time * 1000.0);
+
+    for(dgn::Mesh& m : cold) m.dispose();
+    for(dgn::Mesh& m : warm) m.dispose();
+}
+
+void printMeshOptimizeStats(const char *filepath)
+{
+    std::vector<dgn::MeshOptimizeStats> stats = dgn::Mesh::loadOptimizeStats(filepath);
+
+    printf("MESH OPTIMIZE %s\n", filepath);
+    for(unsigned i = 0; i < stats.size(); i++)
+    {
+        printf("\tmesh %u: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", i,
+               stats[i].before.acmr, stats[i].after.acmr, stats[i].before.atvr, stats[i].after.atvr);
+    }
+}
+
+void benchmarkDebugModes(dgn::Window *window, const dgn::Mesh& mesh, const dgn::Shader& shader)
+{
+    const unsigned draw_count = 20000;
+    const dgn::DebugMode modes[] = {dgn::DebugMode::None, dgn::DebugMode::GetError, dgn::DebugMode::Async, dgn::DebugMode::Synchronous};
+    const char *names[] = {"none", "glGetError", "async", "synchronous"};
+
+    dgn::DebugMode previous = dgn::getDebugMode();
+    dgn::Renderer& renderer = window->getRenderer();
+
+    // one pixel, so the driver's per call cost dominates
+    renderer.setViewport(0, 0, 1, 1);
+    renderer.bindShader(shader);
+    renderer.bindMesh(mesh);
+
+    printf("DEBUG MODES %u draws\n", draw_count);
+    for(unsigned m = 0; m < 4; m++)
+    {
+        if(!dgn::setDebugMode(modes[m]))
+        {
+            printf("\t%s: unsupported\n", names[m]);
+            continue;
+        }
+
+        renderer.drawBoundMesh();
+        renderer.finish();
+
+        double start = window->getTime();
+        for(unsigned i = 0; i < draw_count; i++)
+        {
+            renderer.drawBoundMesh();
+        }
+        renderer.finish();
+        double time = window->getTime() - start;
+
+        printf("\t%s: %.3f ms, %.0f draws/ms\n", names[m], time * 1000.0, draw_count / (time * 1000.0));
+    }
+
+    dgn::setDebugMode(previous);
+}
+
 bool cam_lock = false;
 
 void updateCamera(dgn::Camera *camera, dgn::Window *window, float delta, bool controller)
 {
+    DGN_PROFILE_SCOPE("CameraUpdate");
+
     float camera_rot_speed = PI * delta;
     float camera_move_speed = 2.0f * delta;
     m3d::quat camera_rot_y;
@@ -1035,3 +1472,112 @@ void drawPoint(const m3d::vec3& point, int uniforms[], const dgn::Renderer& rend
 //TODO: move physics to new "Tiger Engine"
 
 //TODO: make first dll and start demo game
+
+void benchmarkShadowFit(dgn::Window *window, const float *distances)
+{
+    const unsigned iterations = 100000;
+
+    dgn::CascadedShadowMap shadowmap;
+    shadowmap.initialize(SHADOW_SIZE, SHADOW_SIZE, SHADOW_CASCADES);
+    shadowmap.updateViewMat(m3d::vec3(1.0, -1.0, -1.0).normalized());
+
+    dgn::Camera camera;
+    camera.width = WINDOW_WIDTH;
+    camera.height = WINDOW_HEIGHT;
+    camera.position = m3d::vec3(3.0f, 2.0f, -4.0f);
+
+    // per cascade fit, pairwise corner distances in light space
+    double start = window->getTime();
+    for(unsigned n = 0; n < iterations; n++)
+    {
+        for(int i = 0; i < SHADOW_CASCADES; i++)
+        {
+            shadowmap.updateProjectionMatFitted(i, camera, distances[i], distances[i+1], 10.0f, 1.0f / PI);
+        }
+    }
+    double single_time = window->getTime() - start;
+
+    m3d::mat4x4 single[SHADOW_CASCADES];
+    shadowmap.invalidate().selectCascades();
+    for(int i = 0; i < SHADOW_CASCADES; i++)
+    {
+        single[i] = shadowmap.getLightMat(i);
+    }
+
+    // batched fit, analytic spheres
+    start = window->getTime();
+    for(unsigned n = 0; n < iterations; n++)
+    {
+        shadowmap.updateProjectionMatsFitted(camera, distances, 10.0f, 1.0f / PI);
+    }
+    double batched_time = window->getTime() - start;
+
+    float max_error = 0.0f;
+    shadowmap.invalidate().selectCascades();
+    for(int i = 0; i < SHADOW_CASCADES; i++)
+    {
+        m3d::mat4x4 batched = shadowmap.getLightMat(i);
+        for(int r = 0; r < 4; r++)
+        {
+            for(int c = 0; c < 4; c++)
+            {
+                max_error = std::max(max_error, std::abs(batched.m[r][c] - single[i].m[r][c]));
+            }
+        }
+    }
+
+    printf("SHADOW FIT %u x %d cascades\n\tper cascade: %.1f ns\n\tbatched: %.1f ns\n\tmax matrix difference: %g\n",
+           iterations, SHADOW_CASCADES, single_time * 1e9 / iterations, batched_time * 1e9 / iterations, max_error);
+
+    shadowmap.dispose();
+}
+
+FrameWorker::FrameWorker(std::function<void()> job) : m_job(job), m_pending(false), m_quit(false)
+{
+    m_thread = std::thread(&FrameWorker::runInternal, this);
+}
+
+FrameWorker::~FrameWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+
+    m_signal.notify_all();
+    m_thread.join();
+}
+
+void FrameWorker::runInternal()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while(true)
+    {
+        m_signal.wait(lock, [this]() { return m_pending || m_quit; });
+        if(m_quit) return;
+
+        lock.unlock();
+        m_job();
+        lock.lock();
+
+        m_pending = false;
+        m_signal.notify_all();
+    }
+}
+
+void FrameWorker::kick()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = true;
+    }
+
+    m_signal.notify_all();
+}
+
+void FrameWorker::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_signal.wait(lock, [this]() { return !m_pending; });
+}